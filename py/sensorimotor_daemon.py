@@ -0,0 +1,47 @@
+#!/usr/bin/python
+
+""" owns the bus and serves its state to other processes, see SensorimotorClient,
+    usage: sensorimotor_daemon.py [name [number_of_motors [update_rate_Hz]]] """
+
+from src.sensorimotor import Sensorimotor
+from time import sleep
+import signal
+import sys
+
+def terminate(signum, frame):
+    raise SystemExit
+
+def main():
+    name = sys.argv[1] if len(sys.argv) > 1 else 'sensorimotor'
+    number_of_motors = int(sys.argv[2]) if len(sys.argv) > 2 else 8
+    update_rate_Hz = float(sys.argv[3]) if len(sys.argv) > 3 else 100
+
+    motors = Sensorimotor(number_of_motors=number_of_motors, update_rate_Hz=update_rate_Hz, verbose=False)
+
+    # checking for motors
+    N = motors.ping()
+    print("Found {0} sensorimotors.".format(N))
+
+    # the group may send setpoints, others only read the state
+    if not motors.start_server(name, command_mode=0o660):
+        print("Could not serve '{0}', is another daemon running?".format(name))
+        return
+
+    signal.signal(signal.SIGTERM, terminate)
+    motors.start()
+    print("Serving '{0}', stop with Ctrl-C.".format(name))
+
+    try:
+        while(True):
+            sleep(1.0)
+
+    except (KeyboardInterrupt, SystemExit):
+        print("\rAborted, stopping motors")
+
+    motors.stop()
+    motors.stop_server()
+    print("____\nDONE.")
+
+
+if __name__ == "__main__":
+    main()
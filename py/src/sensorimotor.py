@@ -10,78 +10,239 @@
 
 """
 
-#TODO: let the library drive each motor in a different control mode
-
 from ctypes import cdll
-from ctypes import c_int, c_uint, c_double, c_char_p, c_void_p, c_bool
+from ctypes import c_int, c_uint, c_double, c_char_p, c_void_p, c_bool, c_longlong, c_ulonglong, POINTER
 
+import json
 import threading
 from time import sleep
 
 # Loading shared Library
 lib = cdll.LoadLibrary('../bin/libsensorimotor.so')
 
+# rows of the state table, see state_export::field_t
+STATE_FIELDS = ( 'position', 'velocity', 'current', 'voltage_supply', 'voltage_backemf'
+               , 'temperature', 'acceleration_x', 'acceleration_y', 'acceleration_z'
+               , 'output_voltage', 'active', 'errors', 'timeouts', 'checksum_errors'
+               , 'unknown_commands', 'response_time_us', 'avg_resp_time_us', 'max_resp_time_us'
+               , 'timeout_us', 'faulted', 'health', 'send_errors', 'skipped' )
+
+# health states of a motor, see sensorimotor::health_t
+HEALTH_STATES = ( 'active', 'degraded', 'quarantined' )
+
+# controller types, see sensorimotor::Controller_t
+CONTROLLER_TYPES = ( 'none', 'voltage', 'position', 'csl', 'impulse' )
+
+# linear sensor calibration (value = raw * gain + offset), see sensor_calibration
+CALIBRATION_FIELDS = ( 'current_gain', 'current_offset', 'voltage_gain', 'voltage_offset'
+                     , 'temperature_gain', 'temperature_offset'
+                     , 'acceleration_gain_x', 'acceleration_gain_y', 'acceleration_gain_z'
+                     , 'acceleration_offset_x', 'acceleration_offset_y', 'acceleration_offset_z' )
+
+# handling of missed cycle deadlines, see periodic_scheduler
+DEADLINE_POLICIES = ( 'skip', 'catch_up' )
+
+# phase durations of a bus cycle, see cycle_timing
+TIMING_FIELDS = ( 'cycle', 'send_us', 'wait_us', 'read_us', 'parse_us', 'controller_us'
+                , 'total_us', 'slack_us', 'unknown_commands', 'lateness_us', 'overruns', 'skipped'
+                , 'send_errors' )
+
+
+def command_arrays(owner, modes, setpoints, gains, limits):
+    """ fills the ctypes buffers of owner with the arguments of set_commands """
+    N = len(modes)
+    assert N <= owner.number_of_motors and len(setpoints) == N
+    c_modes = owner.modes_buffer
+    c_modes[:N] = [CONTROLLER_TYPES.index(m) if isinstance(m, str) else int(m) for m in modes]
+    c_setpoints = owner.values_buffer
+    c_setpoints[:N] = [float(s) for s in setpoints]
+    c_gains = None
+    c_limits = None
+    if gains is not None:
+        assert len(gains) == N
+        c_gains = owner.gains_buffer
+        c_gains[:2*N] = [float(g) for pair in gains for g in pair]
+    if limits is not None:
+        assert len(limits) == N
+        c_limits = owner.limits_buffer
+        c_limits[:2*N] = [float(l) for pair in limits for l in pair]
+    return (c_modes, c_setpoints, c_gains, c_limits, c_uint(N))
+
+
+def command_buffers(owner, M):
+    owner.values_buffer = (c_double * M)()
+    owner.modes_buffer = (c_int * M)()
+    owner.gains_buffer = (c_double * (2*M))()
+    owner.limits_buffer = (c_double * (2*M))()
+
 
 class Sensorimotor(object):
-    def __init__(self, number_of_motors = 127, update_rate_Hz = 100, verbose = True):
+    def __init__(self, number_of_motors = 127, update_rate_Hz = 100, verbose = True,
+                 device = None, baudrate = 0, low_latency = True, latency_timer_ms = 1):
+        """ device is a name like 'ttyUSB0' or a path, e.g. below /dev/serial/by-id/,
+            None tries ttyUSB1, then ttyUSB0, baudrate 0 selects 1 Mbaud, any other
+            rate the adapter supports may be given, low_latency and latency_timer_ms
+            (FTDI adapters, None leaves it unchanged) reduce the round-trip times """
 
         set_types()
 
         # preparing interface and motors
-        self.obj = lib.sensorimotor_new(c_uint(number_of_motors), c_double(update_rate_Hz), c_bool(verbose))
+        self.obj = lib.sensorimotor_new_with_options(c_uint(number_of_motors), c_double(update_rate_Hz), c_bool(verbose),
+                                                     device.encode() if device else None, c_uint(baudrate),
+                                                     c_bool(low_latency), c_int(-1 if latency_timer_ms is None else latency_timer_ms))
         self.number_of_motors = number_of_motors
 
 
         # creating thread
         self.stop_t = threading.Event()
         self.loop_t = threading.Thread(target=self.__execute_cycle)
+        self.native_thread = False
 
         #self.target_position = [0.0] * self.number_of_motors
         self.motor_data = [0.0] * self.number_of_motors #TODO currently only positions
 
+        # ctypes buffers reused by the calls, instead of building new arrays each time
+        M = self.number_of_motors
+        self.motor_buffer = (c_double * M)()
+        command_buffers(self, M)
+        self.timing_buffer = (c_double * len(TIMING_FIELDS))()
+        self.state = None
+        self.observations = None
+
 
     def __del__(self):
          lib.sensorimotor_del(self.obj)
 
 
-    def start(self):
-        self.stop_t.clear()
-        self.loop_t.start()
+    def start(self, native_thread = True, priority = 0, cpu = -1):
+        """ native_thread runs the bus cycles in the library, without the GIL,
+            priority > 0 selects SCHED_FIFO, cpu >= 0 pins the bus thread """
+        self.native_thread = native_thread
+        if native_thread:
+            n = lib.sensorimotor_start_bus_thread(self.obj, c_int(priority), c_int(cpu))
+        else:
+            self.stop_t.clear()
+            self.loop_t.start()
 
 
     def stop(self):
-        self.stop_t.set()
-        self.loop_t.join()
+        if self.native_thread:
+            n = lib.sensorimotor_stop_bus_thread(self.obj)
+        else:
+            self.stop_t.set()
+            self.loop_t.join()
+
+
+    def set_log_rate_limit(self, lines_per_s = 200, burst = 200):
+        """ the library's messages, including the lines of the verbose mode, are
+            written by a background thread, at most lines_per_s (0 = unlimited),
+            lines beyond are dropped and counted """
+        n = lib.sensorimotor_set_log_rate_limit(self.obj, c_uint(lines_per_s), c_uint(burst))
+
+
+    def lock_memory(self):
+        """ locks the memory of the process, so the bus cycles do not stall on page
+            faults, call before start, requires CAP_IPC_LOCK or a memlock limit """
+        return lib.sensorimotor_lock_memory(self.obj) == 0
 
 
+    def start_rx_thread(self, priority = 0, cpu = -1):
+        """ reads the serial device continuously in a thread of its own and
+            timestamps the received bytes on arrival, start it before the bus
+            thread, priority > 0 selects SCHED_FIFO, cpu >= 0 pins the thread """
+        return lib.sensorimotor_start_rx_thread(self.obj, c_int(priority), c_int(cpu)) == 0
+
+
+    def stop_rx_thread(self):
+        n = lib.sensorimotor_stop_rx_thread(self.obj)
+
+
+    def __values(self, values):
+        N = len(values)
+        assert N <= self.number_of_motors
+        self.values_buffer[:N] = list(values)
+        return self.values_buffer, c_uint(N)
+
     def set_position(self, positions):
-        assert len(positions) <= self.number_of_motors
-        target_position = list(positions)
-        carray = (c_double * len(target_position))(*target_position)
-        n = lib.sensorimotor_set_position(self.obj, carray, c_uint(len(carray)))
+        n = lib.sensorimotor_set_position(self.obj, *self.__values(positions))
 
     def set_voltage_limit(self, limits):
-        assert len(limits) <= self.number_of_motors
-        target_limits = list(limits)
-        carray = (c_double * len(target_limits))(*target_limits)
-        n = lib.sensorimotor_set_voltage_limit(self.obj, carray, c_uint(len(carray)))
+        n = lib.sensorimotor_set_voltage_limit(self.obj, *self.__values(limits))
 
     def apply_impulse(self, impulses):
-        assert len(impulses) <= self.number_of_motors
-        target_impulses = list(impulses)
-        carray = (c_double * len(target_impulses))(*target_impulses)
-        n = lib.sensorimotor_apply_impulse(self.obj, carray, c_uint(len(carray)))
+        n = lib.sensorimotor_apply_impulse(self.obj, *self.__values(impulses))
+
+    def set_commands(self, modes, setpoints, gains = None, limits = None):
+        """ drives each motor in its own mode, applied together at the next cycle
+            modes    : controller type per motor, name or index of CONTROLLER_TYPES
+            setpoints: target voltage, target position, csl mode or impulse value
+            gains    : (Kp, Ki) for position, (feedback, -) for csl,
+                       (duration, -) for impulse per motor, None keeps the current ones
+            limits   : (lo, hi) position range per motor, outside the motor is disabled """
+        args = command_arrays(self, modes, setpoints, gains, limits)
+        n = lib.sensorimotor_set_commands(self.obj, *args)
+
+    def step(self, modes = None, setpoints = None, gains = None, limits = None, paced = True):
+        """ lockstep: applies the commands (see set_commands), runs exactly one cycle
+            and returns (cycle, timestamp, state) of that cycle, where state is a NumPy
+            array of shape (len(STATE_FIELDS), motors), overwritten by the next step.
+            Without pacing the next cycle starts as soon as step is called. """
+        M = self.number_of_motors
+        if self.observations is None:
+            import numpy
+            assert lib.sensorimotor_get_state_fields() == len(STATE_FIELDS)
+            self.observations = numpy.zeros(2 + len(STATE_FIELDS) * M)
+        if modes is None:
+            args = (None, None, None, None, c_uint(0))
+        else:
+            args = command_arrays(self, modes, setpoints, gains, limits)
+        obs = self.observations
+        n = lib.sensorimotor_step(self.obj, *(args + (obs.ctypes.data, c_uint(M), c_bool(paced))))
+        return int(obs[0]), obs[1], obs[2:].reshape((len(STATE_FIELDS), M))
 
     def __get_motor_data(self):
-        carray = (c_double * len(self.motor_data))(*self.motor_data)
+        carray = self.motor_buffer
         n = lib.sensorimotor_get_motor_data(self.obj, carray, c_uint(len(carray)))
         self.motor_data = list(carray)
         
 
     def get_position(self):
+        if self.native_thread:
+            self.__get_motor_data()
         return self.motor_data
 
 
+    def get_state(self):
+        """ returns a NumPy array of shape (len(STATE_FIELDS), motors) mapped
+            onto the library's state table, refreshed on every call """
+        if self.state is None:
+            import numpy
+            assert lib.sensorimotor_get_state_fields() == len(STATE_FIELDS)
+            M = lib.sensorimotor_get_number_of_motors(self.obj)
+            ptr = lib.sensorimotor_get_state_table(self.obj)
+            self.state = numpy.ctypeslib.as_array(ptr, shape=(len(STATE_FIELDS), M))
+        lib.sensorimotor_update_state(self.obj)
+        return self.state
+
+
+    def get_state_field(self, name):
+        return self.get_state()[STATE_FIELDS.index(name)]
+
+
+    def get_cycle_timing(self):
+        carray = self.timing_buffer
+        n = lib.sensorimotor_get_cycle_timing(self.obj, carray, c_uint(len(carray)))
+        return dict(zip(TIMING_FIELDS, carray))
+
+
+    def get_histograms(self):
+        """ returns per motor response time counts, bucket b > 0 counts [2^b, 2^(b+1)) us """
+        B = lib.sensorimotor_get_histogram_size()
+        carray = (c_uint * (B * self.number_of_motors))()
+        n = lib.sensorimotor_get_histograms(self.obj, carray, c_uint(len(carray)))
+        return [list(carray[i*B:(i+1)*B]) for i in range(self.number_of_motors)]
+
+
     def __execute_cycle(self):
         while(not self.stop_t.is_set()):
             n = lib.sensorimotor_execute_cycle(self.obj)
@@ -91,16 +252,313 @@ class Sensorimotor(object):
                 stop(self)
 
 
+    def set_pipeline_depth(self, depth):
+        """ number of motor commands sent ahead of outstanding responses, 1 = sequential,
+            returns False if rejected, e.g. while the bus thread is running """
+        return lib.sensorimotor_set_pipeline_depth(self.obj, c_uint(depth)) == 0
+
+
+    def set_bulk_commands(self, enable):
+        """ send the commands of all motors with a single write per cycle """
+        n = lib.sensorimotor_set_bulk_commands(self.obj, c_bool(enable))
+
+
+    def set_discovery(self, fast, reprobe_per_cycle = 0):
+        """ fast pings all ids in one burst, reprobe_per_cycle > 0 pings that many
+            inactive ids each cycle to find motors connected later """
+        n = lib.sensorimotor_set_discovery(self.obj, c_bool(fast), c_uint(reprobe_per_cycle))
+
+
+    def set_response_timeout(self, adaptive, floor_us = 300, ceiling_us = 2000, sigma_factor = 4.0, margin_us = 100, motor_id = None):
+        """ adaptive timeout = mean + sigma_factor * stddev + margin of the observed response
+            times, clipped to [floor_us, ceiling_us], for all motors or a single one """
+        if motor_id is None:
+            motor_id = self.number_of_motors
+        n = lib.sensorimotor_set_response_timeout(self.obj, c_uint(motor_id), c_bool(adaptive), c_uint(floor_us)
+                                                 , c_uint(ceiling_us), c_double(sigma_factor), c_uint(margin_us))
+
+
+    def get_calibration(self, motor_id):
+        carray = (c_double * len(CALIBRATION_FIELDS))()
+        n = lib.sensorimotor_get_calibration(self.obj, c_uint(motor_id), carray, c_uint(len(carray)))
+        return dict(zip(CALIBRATION_FIELDS, carray))
+
+
+    def set_calibration(self, calibration, motor_id = None):
+        """ sets the fields given in the dict calibration, see CALIBRATION_FIELDS,
+            for all motors or a single one, the others are kept """
+        ids = range(self.number_of_motors) if motor_id is None else [motor_id]
+        for i in ids:
+            values = self.get_calibration(i)
+            values.update(calibration)
+            carray = (c_double * len(CALIBRATION_FIELDS))(*[values[f] for f in CALIBRATION_FIELDS])
+            n = lib.sensorimotor_set_calibration(self.obj, c_uint(i), carray, c_uint(len(carray)))
+
+
+    def load_calibration(self, path):
+        """ applies a JSON file mapping motor ids (or 'all') to dicts of calibration fields """
+        with open(path) as f:
+            table = json.load(f)
+        if 'all' in table:
+            self.set_calibration(table['all'])
+        for key, calibration in table.items():
+            if key != 'all':
+                self.set_calibration(calibration, int(key))
+
+
+    def set_health_settings(self, quarantine_after = 3, recover_after = 3, probation_interval = 100):
+        """ quarantines motors after quarantine_after consecutive failures (0 disables),
+            pings them every probation_interval cycles, recovery after recover_after successes """
+        n = lib.sensorimotor_set_health_settings(self.obj, c_uint(quarantine_after), c_uint(recover_after)
+                                                , c_uint(probation_interval))
+
+
+    def set_rate_divisor(self, divisor, motor_id = None):
+        """ services all motors or a single one only every divisor cycles,
+            the slower motors are spread evenly over the cycles """
+        if motor_id is None:
+            motor_id = self.number_of_motors
+        n = lib.sensorimotor_set_rate_divisor(self.obj, c_uint(motor_id), c_uint(divisor))
+
+
+    def set_command_suppression(self, enable, keepalive_interval = 10):
+        """ skips idle motors (no controller or voltage control, at rest) whose command
+            is unchanged for up to keepalive_interval cycles in a row, their state is
+            not updated in the meantime, closed-loop motors are never skipped """
+        n = lib.sensorimotor_set_command_suppression(self.obj, c_bool(enable), c_uint(keepalive_interval))
+
+
+    def set_external_sensor(self, enable, motor_id = None):
+        """ enables reading the accelerometer of all motors or a single one """
+        if motor_id is None:
+            motor_id = self.number_of_motors
+        n = lib.sensorimotor_set_external_sensor(self.obj, c_uint(motor_id), c_bool(enable))
+
+
+    def set_external_sensor_schedule(self, divisor, per_cycle = 0):
+        """ polls the accelerometers every divisor cycles, per_cycle > 0 polls
+            only that many motors per polling cycle in turn """
+        n = lib.sensorimotor_set_external_sensor_schedule(self.obj, c_uint(divisor), c_uint(per_cycle))
+
+
+    def set_deferred_decoding(self, enable):
+        """ converts the sensors when the state is read instead of on receipt """
+        n = lib.sensorimotor_set_deferred_decoding(self.obj, c_bool(enable))
+
+
+    def set_deadline_policy(self, policy):
+        """ 'skip' drops missed cycle deadlines, 'catch_up' runs the missed cycles back to back """
+        n = lib.sensorimotor_set_deadline_policy(self.obj, c_int(DEADLINE_POLICIES.index(policy)))
+
+
+    def set_controller_bank(self, enable):
+        """ step the controllers of all motors in one pass """
+        n = lib.sensorimotor_set_controller_bank(self.obj, c_bool(enable))
+
+
+    def start_recording(self, path, capacity, ring = False):
+        """ records the state of all motors after each cycle to a file with room for
+            capacity records, ring overwrites the oldest, read with load_recording """
+        n = lib.sensorimotor_start_recording(self.obj, path.encode(), c_ulonglong(capacity), c_bool(ring))
+        return n == 0
+
+
+    def stop_recording(self):
+        n = lib.sensorimotor_stop_recording(self.obj)
+
+
+    def start_capture(self, path, capacity):
+        """ captures the raw bus traffic to a file with room for capacity bytes,
+            to be replayed without hardware, see bus_capture.hpp """
+        n = lib.sensorimotor_start_capture(self.obj, path.encode(), c_ulonglong(capacity))
+        return n == 0
+
+
+    def stop_capture(self):
+        n = lib.sensorimotor_stop_capture(self.obj)
+
+
+    def start_server(self, name, command_mode = 0o600):
+        """ serves the state to other processes, see SensorimotorClient, and takes
+            the setpoints of one of them, command_mode are the permissions of the
+            setpoints, 0o660 lets the group write, call before start """
+        n = lib.sensorimotor_start_server(self.obj, name.encode(), c_uint(command_mode))
+        return n == 0
+
+
+    def stop_server(self):
+        n = lib.sensorimotor_stop_server(self.obj)
+
+
     def ping(self):
         n = lib.sensorimotor_ping(self.obj)
         return n
 
 
+class MultiSensorimotor(object):
+    def __init__(self, number_of_motors = 127, update_rate_Hz = 100, verbose = True,
+                 devices = ('ttyUSB0', 'ttyUSB1'), baudrate = 0, low_latency = True, latency_timer_ms = 1):
+        """ motors distributed over several buses, one device (name or path) each, the
+            buses run concurrently and each motor is found on the bus it answers on,
+            the other options apply to all buses, see Sensorimotor """
+
+        set_types()
+
+        self.obj = lib.sensorimotor_multi_new(c_uint(number_of_motors), c_double(update_rate_Hz), c_bool(verbose),
+                                              ','.join(devices).encode(), c_uint(baudrate),
+                                              c_bool(low_latency), c_int(-1 if latency_timer_ms is None else latency_timer_ms))
+        if not self.obj:
+            raise IOError("no devices given")
+        self.number_of_motors = number_of_motors
+
+        self.stop_t = threading.Event()
+        self.loop_t = None
+
+        M = self.number_of_motors
+        self.motor_buffer = (c_double * M)()
+        self.values_buffer = (c_double * M)()
+
+
+    def __del__(self):
+        if getattr(self, 'obj', None):
+            lib.sensorimotor_multi_del(self.obj)
+
+
+    def start(self):
+        self.stop_t.clear()
+        self.loop_t = threading.Thread(target=self.__execute_cycle)
+        self.loop_t.start()
+
+
+    def stop(self):
+        self.stop_t.set()
+        if self.loop_t is not None:
+            self.loop_t.join()
+            self.loop_t = None
+
+
+    def __execute_cycle(self):
+        while(not self.stop_t.is_set()):
+            n = lib.sensorimotor_multi_execute_cycle(self.obj)
+            if (n < 0):
+                print("unexpected stop")
+                self.stop_t.set()
+
+
+    def __values(self, values):
+        N = len(values)
+        assert N <= self.number_of_motors
+        self.values_buffer[:N] = list(values)
+        return self.values_buffer, c_uint(N)
+
+    def set_position(self, positions):
+        n = lib.sensorimotor_multi_set_position(self.obj, *self.__values(positions))
+
+    def set_voltage_limit(self, limits):
+        n = lib.sensorimotor_multi_set_voltage_limit(self.obj, *self.__values(limits))
+
+    def get_position(self):
+        carray = self.motor_buffer
+        n = lib.sensorimotor_multi_get_motor_data(self.obj, carray, c_uint(len(carray)))
+        return list(carray)
+
+
+    def set_reprobe_per_cycle(self, n):
+        """ probes n missing ids per cycle and bus, buses without motors are left out of the cycles otherwise """
+        n = lib.sensorimotor_multi_set_reprobe_per_cycle(self.obj, c_uint(n))
+
+
+    def get_number_of_buses(self):
+        return lib.sensorimotor_multi_get_number_of_buses(self.obj)
+
+
+    def get_bus(self, motor_id):
+        """ index into devices of the bus the motor answered on, None if not found """
+        b = lib.sensorimotor_multi_get_bus(self.obj, c_uint(motor_id))
+        return None if b < 0 else b
+
+
+    def ping(self):
+        n = lib.sensorimotor_multi_ping(self.obj)
+        return n
+
+
+class SensorimotorClient(object):
+    def __init__(self, name, writer = False):
+        """ connects to the state of a Sensorimotor serving as name (see start_server)
+            in another process, a writer may send the setpoints, one at a time """
+        set_types()
+        self.obj = lib.sensorimotor_client_new(name.encode(), c_bool(writer))
+        if not self.obj:
+            raise IOError("no sensorimotor server '%s'" % name)
+        self.number_of_motors = lib.sensorimotor_client_get_number_of_motors(self.obj)
+
+        import numpy
+        assert lib.sensorimotor_get_state_fields() == len(STATE_FIELDS)
+        M = self.number_of_motors
+        self.observations = numpy.zeros(2 + len(STATE_FIELDS) * M)
+        command_buffers(self, M)
+
+
+    def __del__(self):
+        if getattr(self, 'obj', None):
+            lib.sensorimotor_client_del(self.obj)
+
+
+    def read(self):
+        """ returns (cycle, timestamp, state) of the latest cycle, state as in
+            Sensorimotor.step, or None if the server stopped """
+        M = self.number_of_motors
+        obs = self.observations
+        n = lib.sensorimotor_client_read_state(self.obj, obs.ctypes.data, c_uint(M))
+        if n < 0:
+            return None
+        return int(obs[0]), obs[1], obs[2:].reshape((len(STATE_FIELDS), M))
+
+
+    def set_commands(self, modes, setpoints, gains = None, limits = None):
+        """ as Sensorimotor.set_commands, applied by the server at its next cycle """
+        args = command_arrays(self, modes, setpoints, gains, limits)
+        return lib.sensorimotor_client_set_commands(self.obj, *args) == 0
+
+
+def load_recording(path):
+    """ maps a telemetry file written by start_recording, see telemetry_recorder.hpp,
+        returns the records in order of recording as NumPy record array """
+    import numpy
+    header_t = numpy.dtype([ ('magic', 'S8'), ('header_size', '<u4'), ('num_motors', '<u4')
+                           , ('record_size', '<u4'), ('flags', '<u4'), ('capacity', '<u8')
+                           , ('count', '<u8'), ('dropped', '<u8'), ('reserved', 'V16') ])
+    header = numpy.fromfile(path, dtype=header_t, count=1)[0]
+    assert header['magic'] == b'SMTELEM1'
+    motor_t = numpy.dtype([ ('position', '<f4'), ('velocity', '<f4'), ('current', '<f4')
+                          , ('voltage_supply', '<f4'), ('voltage_backemf', '<f4'), ('temperature', '<f4')
+                          , ('acceleration_x', '<f4'), ('acceleration_y', '<f4'), ('acceleration_z', '<f4')
+                          , ('output_voltage', '<f4'), ('response_time_us', '<u4'), ('errors', '<u2')
+                          , ('timeouts', '<u2'), ('checksum_errors', '<u2'), ('active', 'u1'), ('faulted', 'u1') ])
+    record_t = numpy.dtype([ ('cycle', '<u8'), ('timestamp_ns', '<u8'), ('motor', motor_t, (int(header['num_motors']),)) ])
+    padding = int(header['record_size']) - record_t.itemsize # to a multiple of 8 bytes
+    assert 0 <= padding < 8
+    if padding > 0:
+        record_t = numpy.dtype(record_t.descr + [ ('padding', 'V%d' % padding) ])
+    assert record_t.itemsize == header['record_size']
+
+    count, capacity = int(header['count']), int(header['capacity'])
+    records = numpy.memmap(path, dtype=record_t, mode='r', offset=int(header['header_size']), shape=(min(count, capacity),))
+    if count <= capacity:
+        return records
+    first = count % capacity # ring mode, wrapped around
+    return numpy.concatenate((records[first:], records[:first]))
+
+
 
 def set_types():
     lib.sensorimotor_new.argtypes = [c_uint, c_double, c_bool]
     lib.sensorimotor_new.restype = c_void_p
 
+    lib.sensorimotor_new_with_options.argtypes = [c_uint, c_double, c_bool, c_char_p, c_uint, c_bool, c_int]
+    lib.sensorimotor_new_with_options.restype = c_void_p
+
     lib.sensorimotor_ping.argtypes = [c_void_p]
     lib.sensorimotor_ping.restype = c_int
 
@@ -119,7 +577,155 @@ def set_types():
     lib.sensorimotor_apply_impulse.argtypes = [c_void_p, c_void_p, c_uint]
     lib.sensorimotor_apply_impulse.restype = c_int
 
+    lib.sensorimotor_set_commands.argtypes = [c_void_p, c_void_p, c_void_p, c_void_p, c_void_p, c_uint]
+    lib.sensorimotor_set_commands.restype = c_int
+
+    lib.sensorimotor_step.argtypes = [c_void_p, c_void_p, c_void_p, c_void_p, c_void_p, c_uint, c_void_p, c_uint, c_bool]
+    lib.sensorimotor_step.restype = c_longlong
+
     lib.sensorimotor_get_motor_data.argtypes = [c_void_p, c_void_p, c_uint]
     lib.sensorimotor_get_motor_data.restype = c_int
 
+    lib.sensorimotor_get_state_fields.argtypes = []
+    lib.sensorimotor_get_state_fields.restype = c_uint
+
+    lib.sensorimotor_get_number_of_motors.argtypes = [c_void_p]
+    lib.sensorimotor_get_number_of_motors.restype = c_uint
+
+    lib.sensorimotor_get_state_table.argtypes = [c_void_p]
+    lib.sensorimotor_get_state_table.restype = POINTER(c_double)
+
+    lib.sensorimotor_update_state.argtypes = [c_void_p]
+    lib.sensorimotor_update_state.restype = c_longlong
+
+    lib.sensorimotor_get_cycle_timing.argtypes = [c_void_p, c_void_p, c_uint]
+    lib.sensorimotor_get_cycle_timing.restype = c_int
+
+    lib.sensorimotor_get_histogram_size.argtypes = []
+    lib.sensorimotor_get_histogram_size.restype = c_uint
+
+    lib.sensorimotor_get_histograms.argtypes = [c_void_p, c_void_p, c_uint]
+    lib.sensorimotor_get_histograms.restype = c_int
+
+    lib.sensorimotor_start_bus_thread.argtypes = [c_void_p, c_int, c_int]
+    lib.sensorimotor_start_bus_thread.restype = c_int
+
+    lib.sensorimotor_stop_bus_thread.argtypes = [c_void_p]
+    lib.sensorimotor_stop_bus_thread.restype = c_int
+
+    lib.sensorimotor_set_log_rate_limit.argtypes = [c_void_p, c_uint, c_uint]
+    lib.sensorimotor_set_log_rate_limit.restype = c_int
+
+    lib.sensorimotor_lock_memory.argtypes = [c_void_p]
+    lib.sensorimotor_lock_memory.restype = c_int
+
+    lib.sensorimotor_start_rx_thread.argtypes = [c_void_p, c_int, c_int]
+    lib.sensorimotor_start_rx_thread.restype = c_int
+
+    lib.sensorimotor_stop_rx_thread.argtypes = [c_void_p]
+    lib.sensorimotor_stop_rx_thread.restype = c_int
+
+    lib.sensorimotor_set_discovery.argtypes = [c_void_p, c_bool, c_uint]
+    lib.sensorimotor_set_discovery.restype = c_int
+
+    lib.sensorimotor_set_response_timeout.argtypes = [c_void_p, c_uint, c_bool, c_uint, c_uint, c_double, c_uint]
+    lib.sensorimotor_set_response_timeout.restype = c_int
+
+    lib.sensorimotor_start_recording.argtypes = [c_void_p, c_char_p, c_ulonglong, c_bool]
+    lib.sensorimotor_start_recording.restype = c_int
+
+    lib.sensorimotor_stop_recording.argtypes = [c_void_p]
+    lib.sensorimotor_stop_recording.restype = c_int
+
+    lib.sensorimotor_start_capture.argtypes = [c_void_p, c_char_p, c_ulonglong]
+    lib.sensorimotor_start_capture.restype = c_int
+
+    lib.sensorimotor_stop_capture.argtypes = [c_void_p]
+    lib.sensorimotor_stop_capture.restype = c_int
+
+    lib.sensorimotor_set_calibration.argtypes = [c_void_p, c_uint, c_void_p, c_uint]
+    lib.sensorimotor_set_calibration.restype = c_int
+
+    lib.sensorimotor_get_calibration.argtypes = [c_void_p, c_uint, c_void_p, c_uint]
+    lib.sensorimotor_get_calibration.restype = c_int
+
+    lib.sensorimotor_set_health_settings.argtypes = [c_void_p, c_uint, c_uint, c_uint]
+    lib.sensorimotor_set_health_settings.restype = c_int
+
+    lib.sensorimotor_set_rate_divisor.argtypes = [c_void_p, c_uint, c_uint]
+    lib.sensorimotor_set_rate_divisor.restype = c_int
+
+    lib.sensorimotor_set_command_suppression.argtypes = [c_void_p, c_bool, c_uint]
+    lib.sensorimotor_set_command_suppression.restype = c_int
+
+    lib.sensorimotor_set_external_sensor.argtypes = [c_void_p, c_uint, c_bool]
+    lib.sensorimotor_set_external_sensor.restype = c_int
+
+    lib.sensorimotor_set_external_sensor_schedule.argtypes = [c_void_p, c_uint, c_uint]
+    lib.sensorimotor_set_external_sensor_schedule.restype = c_int
+
+    lib.sensorimotor_set_deferred_decoding.argtypes = [c_void_p, c_bool]
+    lib.sensorimotor_set_deferred_decoding.restype = c_int
+
+    lib.sensorimotor_set_deadline_policy.argtypes = [c_void_p, c_int]
+    lib.sensorimotor_set_deadline_policy.restype = c_int
+
+    lib.sensorimotor_set_controller_bank.argtypes = [c_void_p, c_bool]
+    lib.sensorimotor_set_controller_bank.restype = c_int
+
+    lib.sensorimotor_set_pipeline_depth.argtypes = [c_void_p, c_uint]
+    lib.sensorimotor_set_pipeline_depth.restype = c_int
+
+    lib.sensorimotor_set_bulk_commands.argtypes = [c_void_p, c_bool]
+    lib.sensorimotor_set_bulk_commands.restype = c_int
+
+    lib.sensorimotor_start_server.argtypes = [c_void_p, c_char_p, c_uint]
+    lib.sensorimotor_start_server.restype = c_int
+
+    lib.sensorimotor_stop_server.argtypes = [c_void_p]
+    lib.sensorimotor_stop_server.restype = c_int
+
+    lib.sensorimotor_multi_new.argtypes = [c_uint, c_double, c_bool, c_char_p, c_uint, c_bool, c_int]
+    lib.sensorimotor_multi_new.restype = c_void_p
+
+    lib.sensorimotor_multi_del.argtypes = [c_void_p]
+    lib.sensorimotor_multi_del.restype = c_int
+
+    lib.sensorimotor_multi_execute_cycle.argtypes = [c_void_p]
+    lib.sensorimotor_multi_execute_cycle.restype = c_int
+
+    lib.sensorimotor_multi_set_position.argtypes = [c_void_p, c_void_p, c_uint]
+    lib.sensorimotor_multi_set_position.restype = c_int
+
+    lib.sensorimotor_multi_set_voltage_limit.argtypes = [c_void_p, c_void_p, c_uint]
+    lib.sensorimotor_multi_set_voltage_limit.restype = c_int
+
+    lib.sensorimotor_multi_get_motor_data.argtypes = [c_void_p, c_void_p, c_uint]
+    lib.sensorimotor_multi_get_motor_data.restype = c_int
+
+    lib.sensorimotor_multi_set_reprobe_per_cycle.argtypes = [c_void_p, c_uint]
+    lib.sensorimotor_multi_set_reprobe_per_cycle.restype = c_int
+
+    lib.sensorimotor_multi_get_number_of_buses.argtypes = [c_void_p]
+    lib.sensorimotor_multi_get_number_of_buses.restype = c_uint
+
+    lib.sensorimotor_multi_get_bus.argtypes = [c_void_p, c_uint]
+    lib.sensorimotor_multi_get_bus.restype = c_int
+
+    lib.sensorimotor_multi_ping.argtypes = [c_void_p]
+    lib.sensorimotor_multi_ping.restype = c_int
+
+    lib.sensorimotor_client_new.argtypes = [c_char_p, c_bool]
+    lib.sensorimotor_client_new.restype = c_void_p
+
+    lib.sensorimotor_client_del.argtypes = [c_void_p]
+    lib.sensorimotor_client_del.restype = c_int
+
+    lib.sensorimotor_client_get_number_of_motors.argtypes = [c_void_p]
+    lib.sensorimotor_client_get_number_of_motors.restype = c_uint
+
+    lib.sensorimotor_client_read_state.argtypes = [c_void_p, c_void_p, c_uint]
+    lib.sensorimotor_client_read_state.restype = c_longlong
 
+    lib.sensorimotor_client_set_commands.argtypes = [c_void_p, c_void_p, c_void_p, c_void_p, c_void_p, c_uint]
+    lib.sensorimotor_client_set_commands.restype = c_int
@@ -0,0 +1,292 @@
+/*---------------------------------+
+ | Supreme Machines                |
+ | Sensorimotor C++ Library        |
+ | Bus Benchmark                   |
+ +---------------------------------*/
+
+/* Runs a motorcord against the simulated bus and reports cycles per second,
+   parse throughput and the latency distribution of the cycles.
+
+   usage: benchmark_bus [-m motors] [-n cycles] [-l latency_us] [-j jitter_us]
+                        [-e byte_error_rate] [-b baudrate] [-p pipeline_depth] [-B] [-s]
+                        [-x sensor_divisor] [-R sensors_per_cycle] [-d keepalive_interval]
+                        [-g rate_divisor] [-M buses] [-w capture_file | -r capture_file]
+
+   With -s the motorcord is specialized on the bus at compile time,
+   otherwise the transport is accessed through the virtual interface.
+
+   With -x the external sensors of all motors are read every sensor_divisor
+   cycles, with -R only sensors_per_cycle of them per polling cycle in turn.
+
+   With -d the commands are change-driven, skipping motors with an unchanged
+   command for up to keepalive_interval cycles, see suppression_settings. The
+   motors then idle in voltage control instead of following position targets.
+
+   With -g the second half of the motors forms a slower rate group, serviced
+   every rate_divisor cycles, see motorcord::set_rate_divisor.
+
+   With -M the motors are spread over that many simulated buses, motor i on bus
+   i % buses, driven by a multicord running the buses concurrently. Buses left
+   without motors are not serviced.
+
+   With -w the traffic of the simulated bus is captured to the file, with -r
+   a capture, e.g. of a real bus, is replayed instead of simulating the bus,
+   looping if it has fewer cycles. To be replayed, the capture must be taken
+   with the same number of motors and the same mode (-m, -p, -B).
+
+   With the defaults (no latency, no transfer time) nothing is waited for and
+   the numbers reflect the framing and parsing code only. The results are
+   printed as key=value lines, one per metric, to be compared by scripts.
+*/
+
+#include <unistd.h>
+#include <cinttypes>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+#include "../motorcord.hpp"
+#include "../multicord.hpp"
+#include "../simulated_bus.hpp"
+#include "../replay_bus.hpp"
+
+using namespace supreme;
+
+namespace {
+
+typedef communication_interface::clock_t bench_clock;
+
+uint64_t elapsed_ns(bench_clock::time_point t0, bench_clock::time_point t1) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+}
+
+uint64_t io_ns(io_timing const& io) { return io.send_ns + io.wait_ns + io.read_ns; }
+
+double percentile_us(std::vector<uint64_t> const& sorted_ns, double p) {
+    if (sorted_ns.empty()) return .0;
+    const std::size_t i = std::min(sorted_ns.size() - 1, static_cast<std::size_t>(p * sorted_ns.size()));
+    return sorted_ns[i] / 1000.0;
+}
+
+struct options {
+    unsigned    num_motors  = 16;
+    std::size_t num_cycles  = 10000;
+    std::size_t depth       = 1;
+    bool        bulk        = false;
+    bool        specialized = false;
+    std::size_t sensor_divisor   = 0; /* external sensors disabled */
+    std::size_t sensor_per_cycle = 0;
+    suppression_settings suppression;
+    std::size_t rate_divisor     = 1;
+    std::size_t num_buses        = 0; /* single motorcord */
+    const char* capture     = NULL;
+    const char* replay      = NULL;
+    simulation_settings settings;
+};
+
+template <typename Transport, typename Bus>
+void run(options const& opt, Bus& bus)
+{
+    const unsigned    num_motors = opt.num_motors;
+    const std::size_t num_cycles = opt.num_cycles;
+
+    basic_motorcord<Transport> motors(num_motors, /*verbose=*/false, bus);
+    motors.set_pipeline_depth(opt.depth);
+    motors.set_bulk_commands(opt.bulk);
+    motors.set_external_sensor_schedule(opt.sensor_divisor, opt.sensor_per_cycle);
+    motors.set_suppression_settings(opt.suppression);
+    for (unsigned i = 0; i < num_motors; ++i)
+        motors[i].set_ext_sensor_readout(opt.sensor_divisor > 0);
+    for (unsigned i = num_motors / 2; i < num_motors; ++i)
+        motors.set_rate_divisor(i, opt.rate_divisor);
+
+    /* warm-up, includes the scan */
+    typedef typename basic_motorcord<Transport>::motor_t::Controller_t ctrl;
+    for (unsigned i = 0; i < num_motors; ++i) {
+        motors[i].set_controller_type(opt.suppression.enabled ? ctrl::voltage : ctrl::position);
+        motors[i].set_voltage_limit(0.5);
+    }
+    for (std::size_t c = 0; c < 100; ++c) motors.execute_cycle();
+    motors.reset_statistics();
+
+    std::vector<uint64_t> cycle_ns(num_cycles);
+    uint64_t parse_ns = 0, rx_bytes_max = 0;
+    const uint64_t rx_bytes_0 = bus.get_rx_bytes();
+
+    const auto t_start = bench_clock::now();
+    for (std::size_t c = 0; c < num_cycles; ++c) {
+        for (unsigned i = 0; i < num_motors; ++i)
+            motors[i].set_target_position(0.5 * ((c / 100 + i) % 2 ? 1 : -1));
+
+        const uint64_t io_0 = io_ns(bus.get_io_timing());
+        const uint64_t rx_0 = bus.get_rx_bytes();
+        const auto t0 = bench_clock::now();
+        motors.execute_cycle();
+        cycle_ns[c] = elapsed_ns(t0, bench_clock::now());
+        rx_bytes_max = std::max(rx_bytes_max, bus.get_rx_bytes() - rx_0);
+
+        const uint64_t io = io_ns(bus.get_io_timing()) - io_0;
+        parse_ns += (cycle_ns[c] > io) ? cycle_ns[c] - io : 0;
+    }
+    const double total_s = elapsed_ns(t_start, bench_clock::now()) / 1e9;
+    const uint64_t rx_bytes = bus.get_rx_bytes() - rx_bytes_0;
+
+    unsigned errors = 0, timeouts = 0, checksum_errors = 0, skipped = 0;
+    for (unsigned i = 0; i < num_motors; ++i) {
+        auto const& s = motors[i].get_stats();
+        errors += s.errors;
+        timeouts += s.timeouts;
+        checksum_errors += s.checksum_errors;
+        skipped += s.skipped;
+    }
+
+    std::sort(cycle_ns.begin(), cycle_ns.end());
+
+    printf("motors=%u\n"               , num_motors);
+    printf("cycles=%zu\n"              , num_cycles);
+    printf("mode=%s\n"                 , opt.bulk ? "bulk" : opt.depth > 1 ? "pipelined" : "sequential");
+    printf("dispatch=%s\n"             , opt.specialized ? "static" : "virtual");
+    printf("cycles_per_s=%.1f\n"       , num_cycles / total_s);
+    printf("parse_mb_per_s=%.2f\n"     , parse_ns ? rx_bytes * 1e3 / parse_ns : .0);
+    printf("parse_ns_per_cycle=%.1f\n" , static_cast<double>(parse_ns) / num_cycles);
+    printf("rx_bytes_per_cycle=%.1f\n" , static_cast<double>(rx_bytes) / num_cycles);
+    printf("rx_bytes_max=%lu\n"        , static_cast<unsigned long>(rx_bytes_max));
+    printf("cycle_us_p50=%.2f\n"       , percentile_us(cycle_ns, 0.50));
+    printf("cycle_us_p90=%.2f\n"       , percentile_us(cycle_ns, 0.90));
+    printf("cycle_us_p99=%.2f\n"       , percentile_us(cycle_ns, 0.99));
+    printf("cycle_us_p999=%.2f\n"      , percentile_us(cycle_ns, 0.999));
+    printf("cycle_us_max=%.2f\n"       , cycle_ns.empty() ? .0 : cycle_ns.back() / 1000.0);
+    printf("errors=%u\n"               , errors);
+    printf("timeouts=%u\n"             , timeouts);
+    printf("checksum_errors=%u\n"      , checksum_errors);
+    printf("skipped=%u\n"              , skipped);
+}
+
+void run_multi(options const& opt)
+{
+    const unsigned    num_motors = opt.num_motors;
+    const std::size_t num_cycles = opt.num_cycles;
+
+    std::vector<std::unique_ptr<simulated_bus>> buses; /* outlive the multicord */
+    std::vector<communication_interface*> transports;
+    for (std::size_t b = 0; b < opt.num_buses; ++b) {
+        buses.emplace_back(new simulated_bus(num_motors, opt.settings));
+        for (unsigned i = 0; i < num_motors; ++i) buses[b]->set_present(i, i % opt.num_buses == b);
+        transports.push_back(buses[b].get());
+    }
+
+    multicord motors(num_motors, transports);
+    for (std::size_t b = 0; b < motors.number_of_buses(); ++b) {
+        motors.bus(b).set_pipeline_depth(opt.depth);
+        motors.bus(b).set_bulk_commands(opt.bulk);
+    }
+
+    /* warm-up, includes the scan */
+    motors.scan_for_motors();
+    for (unsigned i = 0; i < num_motors; ++i) {
+        motors[i].set_controller_type(sensorimotor::Controller_t::position);
+        motors[i].set_voltage_limit(0.5);
+    }
+    for (std::size_t c = 0; c < 100; ++c) motors.execute_cycle();
+    motors.reset_statistics();
+
+    std::vector<uint64_t> cycle_ns(num_cycles);
+    const auto t_start = bench_clock::now();
+    for (std::size_t c = 0; c < num_cycles; ++c) {
+        for (unsigned i = 0; i < num_motors; ++i)
+            motors[i].set_target_position(0.5 * ((c / 100 + i) % 2 ? 1 : -1));
+        const auto t0 = bench_clock::now();
+        motors.execute_cycle();
+        cycle_ns[c] = elapsed_ns(t0, bench_clock::now());
+    }
+    const double total_s = elapsed_ns(t_start, bench_clock::now()) / 1e9;
+
+    unsigned errors = 0, timeouts = 0, found = 0;
+    for (unsigned i = 0; i < num_motors; ++i) {
+        auto const& s = motors[i].get_stats();
+        errors += s.errors;
+        timeouts += s.timeouts;
+        found += motors.is_found(i);
+    }
+
+    std::sort(cycle_ns.begin(), cycle_ns.end());
+
+    printf("motors=%u\n"               , num_motors);
+    printf("buses=%zu\n"               , motors.number_of_buses());
+    printf("found=%u\n"                , found);
+    printf("cycles=%zu\n"              , num_cycles);
+    printf("mode=%s\n"                 , opt.bulk ? "bulk" : opt.depth > 1 ? "pipelined" : "sequential");
+    printf("cycles_per_s=%.1f\n"       , num_cycles / total_s);
+    printf("cycle_us_p50=%.2f\n"       , percentile_us(cycle_ns, 0.50));
+    printf("cycle_us_p99=%.2f\n"       , percentile_us(cycle_ns, 0.99));
+    printf("cycle_us_max=%.2f\n"       , cycle_ns.empty() ? .0 : cycle_ns.back() / 1000.0);
+    printf("errors=%u\n"               , errors);
+    printf("timeouts=%u\n"             , timeouts);
+}
+
+template <typename Bus>
+void dispatch(options const& opt, Bus& bus)
+{
+    if (opt.specialized) run<Bus>(opt, bus);
+    else run<communication_interface>(opt, bus);
+}
+
+} /* namespace */
+
+int main(int argc, char* argv[])
+{
+    options o;
+    int c;
+    while ((c = getopt(argc, argv, "m:n:l:j:e:b:p:Bsx:R:d:g:M:w:r:")) != -1) {
+        switch (c) {
+            case 'm': o.num_motors          = std::min<unsigned>(motorcord::max_boards, atoi(optarg)); break;
+            case 'n': o.num_cycles          = strtoul(optarg, NULL, 10); break;
+            case 'l': o.settings.latency_us = atoi(optarg); break;
+            case 'j': o.settings.jitter_us  = atoi(optarg); break;
+            case 'e': o.settings.byte_error_rate = atof(optarg); break;
+            case 'b': o.settings.baudrate   = atoi(optarg); break;
+            case 'p': o.depth               = strtoul(optarg, NULL, 10); break;
+            case 'B': o.bulk                = true; break;
+            case 's': o.specialized         = true; break;
+            case 'x': o.sensor_divisor      = strtoul(optarg, NULL, 10); break;
+            case 'R': o.sensor_per_cycle    = strtoul(optarg, NULL, 10); break;
+            case 'd': o.suppression.enabled = true;
+                      o.suppression.keepalive_interval = strtoul(optarg, NULL, 10); break;
+            case 'g': o.rate_divisor        = strtoul(optarg, NULL, 10); break;
+            case 'M': o.num_buses           = strtoul(optarg, NULL, 10); break;
+            case 'w': o.capture             = optarg; break;
+            case 'r': o.replay              = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [-m motors] [-n cycles] [-l latency_us] [-j jitter_us] "
+                                "[-e byte_error_rate] [-b baudrate] [-p pipeline_depth] [-B] [-s] "
+                                "[-x sensor_divisor] [-R sensors_per_cycle] [-d keepalive_interval] "
+                                "[-g rate_divisor] [-M buses] [-w capture_file | -r capture_file]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (o.num_buses > 0) {
+        run_multi(o);
+        return EXIT_SUCCESS;
+    }
+
+    if (o.replay != NULL) {
+        replay_bus bus(o.replay, /*loop=*/true);
+        if (bus.is_finished()) return EXIT_FAILURE;
+        dispatch(o, bus);
+        printf("replayed_writes=%" PRIu64 "\n", bus.get_turns());
+        return EXIT_SUCCESS;
+    }
+
+    bus_capture capture; /* outlives the motorcord, which sends when destroyed */
+    simulated_bus bus(o.num_motors, o.settings);
+    if (o.capture != NULL) {
+        /* about two chunks per motor and cycle, plus the scan */
+        if (not capture.open(o.capture, (o.num_cycles + 200) * o.num_motors * 80 + (1 << 20)))
+            return EXIT_FAILURE;
+        bus.set_capture(&capture);
+    }
+    dispatch(o, bus);
+    printf("corrupted_bytes=%" PRIu64 "\n", bus.get_corrupted());
+    return EXIT_SUCCESS;
+}
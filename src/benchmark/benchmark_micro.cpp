@@ -0,0 +1,407 @@
+/*---------------------------------+
+ | Supreme Machines                |
+ | Sensorimotor C++ Library        |
+ | Micro Benchmarks                |
+ +---------------------------------*/
+
+/* Times the hot paths of a bus cycle one at a time, for 1 to 128 motors:
+   the controllers, execute_controller of the sensorimotor, the decoding of
+   the responses and the framing in the queues of the transport.
+
+   usage: benchmark_micro [-m max_motors] [-s samples] [-t sample_ms] [-f filter]
+                          [-c baseline_file] [-T threshold]
+
+   Each result is printed as one line of key=value pairs, e.g.
+
+       bench=pid_step motors=16 ns_per_op=1.52 cycles_per_op=4.31
+
+   where an op is the step or frame of a single motor and the value is the
+   median of the samples. Cycles are counted by the time stamp counter (x86
+   only, zero elsewhere), i.e. at its constant rate, not the actual clock of
+   the core. With -f only benchmarks whose name contains the filter are run.
+
+   With -c the results are compared to those of a previous run, stored from
+   its output, adding the baseline and the ratio of both to each line. A
+   result slower than the baseline by more than the threshold (-T, default
+   0.10 for 10%) counts as regression, then the exit status is 2.
+
+   The decoding is timed on the receive path of the pipelined and bulk modes
+   (motorcord::receive_data: scan, dispatch and decode), the one of the
+   sequential mode differs in dispatching only. The queues are those of
+   buffered_communication, which communication_controller uses unchanged, so
+   no serial device is required.
+*/
+
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "../motorcord.hpp"
+
+using namespace supreme;
+
+namespace {
+
+typedef communication_interface::clock_t bench_clock;
+
+inline uint64_t read_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* keeps the compiler from optimizing away the benchmarked computation */
+template <typename T> inline void keep(T const& value) { asm volatile("" : : "g"(&value) : "memory"); }
+
+/* accumulates the time and ticks of the sections between start and stop */
+struct section_timer {
+    uint64_t ns = 0, ticks = 0, sections = 0;
+    bench_clock::time_point t0;
+    uint64_t c0 = 0;
+
+    void start(void) { c0 = read_ticks(); t0 = bench_clock::now(); }
+    void stop (void) {
+        const auto t1 = bench_clock::now();
+        ticks += read_ticks() - c0;
+        ns += std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        ++sections;
+    }
+};
+
+struct result { double ns_per_op, cycles_per_op; };
+
+struct options {
+    unsigned    max_motors = motorcord::max_boards;
+    unsigned    samples    = 7;
+    unsigned    sample_ms  = 20;
+    const char* filter     = NULL;
+    const char* baseline   = NULL;
+    double      threshold  = 0.10;
+};
+
+/* cost of an empty section, subtracted from each timed one */
+struct overhead_t { double ns = .0, ticks = .0; } overhead;
+
+void calibrate(void) {
+    section_timer t;
+    for (unsigned k = 0; k < 100000; ++k) { t.start(); t.stop(); }
+    overhead.ns    = static_cast<double>(t.ns) / t.sections;
+    overhead.ticks = static_cast<double>(t.ticks) / t.sections;
+}
+
+/* runs 'round' repeatedly for each sample, round(timer) times 'ops' operations,
+   returns the median over the samples */
+template <typename Round>
+result measure(options const& opt, std::size_t ops, Round round)
+{
+    std::vector<double> ns, cycles;
+    for (unsigned s = 0; s < opt.samples; ++s) {
+        section_timer t;
+        std::size_t rounds = 0;
+        const auto end = bench_clock::now() + std::chrono::milliseconds(opt.sample_ms);
+        do { round(t); ++rounds; } while (bench_clock::now() < end);
+
+        const double n = static_cast<double>(rounds * ops);
+        ns    .push_back(std::max(.0, t.ns    - t.sections * overhead.ns   ) / n);
+        cycles.push_back(std::max(.0, t.ticks - t.sections * overhead.ticks) / n);
+    }
+    std::sort(ns.begin(), ns.end());
+    std::sort(cycles.begin(), cycles.end());
+    return { ns[ns.size() / 2], cycles[cycles.size() / 2] };
+}
+
+/* a transport without wire: sending drops the commands, the responses are
+   placed into the receive queue by the benchmark */
+class loopback_bus final : public buffered_communication {
+public:
+    void read_msg(void) {}
+    bool send_msg(void) { send_queue.clear(); return true; }
+    bool wait_us(unsigned) const { return true; }
+    void sleep_s(unsigned) const {}
+    bool wait_for_data(clock_t::time_point) const { return false; }
+    unsigned get_baudrate(void) const { return 0; }
+
+    void receive(std::vector<uint8_t> const& bytes) {
+        recv_queue.write(bytes.data(), bytes.size());
+        note_arrival(bytes.size(), clock_t::now());
+    }
+    void clear_received(void) { consume(size()); reset_checksum(); }
+};
+
+/* response frames of motors 0..n-1 with the given command byte */
+std::vector<uint8_t> responses(uint8_t cmd, unsigned n)
+{
+    std::vector<uint8_t> bytes;
+    for (unsigned id = 0; id < n; ++id) {
+        const std::size_t begin = bytes.size();
+        bytes.push_back(0xFF);
+        bytes.push_back(0xFF);
+        bytes.push_back(cmd);
+        bytes.push_back(static_cast<uint8_t>(id));
+        for (std::size_t k = 2; k + 1 < frame_decoder::length(cmd); ++k)
+            bytes.push_back(static_cast<uint8_t>(0x10 + 7 * id + k));
+        uint8_t sum = 0;
+        for (std::size_t k = begin; k < bytes.size(); ++k) sum += bytes[k];
+        bytes.push_back(~sum + 1);
+    }
+    return bytes;
+}
+
+typedef basic_sensorimotor<loopback_bus>  motor_t;
+typedef basic_motorcord<loopback_bus>     cord_t;
+
+const unsigned steps_per_round = 64; /* of the controllers, amortizing the timer */
+
+/* the benchmarks, each timing one round for n motors */
+
+result bench_pid_step(options const& opt, unsigned n) {
+    std::vector<pid_control> ctrl;
+    std::vector<double> p(n);
+    for (unsigned i = 0; i < n; ++i) {
+        ctrl.emplace_back(i);
+        ctrl[i].target_value = 0.5;
+        ctrl[i].Ki = 0.01;
+        p[i] = 0.001 * i;
+    }
+    return measure(opt, n * steps_per_round, [&](section_timer& t) {
+        t.start();
+        for (unsigned k = 0; k < steps_per_round; ++k)
+            for (unsigned i = 0; i < n; ++i) p[i] += 0.01 * ctrl[i].step(p[i]);
+        t.stop();
+        keep(p[0]);
+    });
+}
+
+/* with the mode unchanged, update_mode only compares */
+result bench_csl_step(options const& opt, unsigned n) {
+    std::vector<csl_control> ctrl;
+    std::vector<double> p(n);
+    for (unsigned i = 0; i < n; ++i) {
+        ctrl.emplace_back(i);
+        ctrl[i].target_csl_mode = 0.5;
+        p[i] = 0.001 * i;
+    }
+    return measure(opt, n * steps_per_round, [&](section_timer& t) {
+        for (unsigned i = 0; i < n; ++i) { p[i] = 0.001 * i; ctrl[i].reset(p[i]); } /* keeps the states in range */
+        t.start();
+        for (unsigned k = 0; k < steps_per_round; ++k)
+            for (unsigned i = 0; i < n; ++i) p[i] += 0.01 * ctrl[i].step(p[i]);
+        t.stop();
+        keep(p[0]);
+    });
+}
+
+/* the mode changes every step, update_mode recomputes the gains */
+result bench_csl_update_mode(options const& opt, unsigned n) {
+    std::vector<csl_control> ctrl;
+    std::vector<double> p(n);
+    for (unsigned i = 0; i < n; ++i) {
+        ctrl.emplace_back(i);
+        p[i] = 0.001 * i;
+    }
+    return measure(opt, n * steps_per_round, [&](section_timer& t) {
+        for (unsigned i = 0; i < n; ++i) { p[i] = 0.001 * i; ctrl[i].reset(p[i]); } /* keeps the states in range */
+        t.start();
+        for (unsigned k = 0; k < steps_per_round; ++k)
+            for (unsigned i = 0; i < n; ++i) {
+                ctrl[i].target_csl_mode = (k & 1) ? 0.5 : -0.5;
+                p[i] += 0.01 * ctrl[i].step(p[i]);
+            }
+        t.stop();
+        keep(p[0]);
+    });
+}
+
+result bench_impulse_step(options const& opt, unsigned n) {
+    std::vector<impulse_control> ctrl;
+    double sum = .0;
+    for (unsigned i = 0; i < n; ++i) {
+        ctrl.emplace_back(i);
+        ctrl[i].value = 0.1 * i;
+    }
+    return measure(opt, n * steps_per_round, [&](section_timer& t) {
+        for (auto& c : ctrl) c.duration = steps_per_round / 2 + (&c - ctrl.data()) % steps_per_round;
+        t.start();
+        for (unsigned k = 0; k < steps_per_round; ++k)
+            for (unsigned i = 0; i < n; ++i) sum += ctrl[i].step();
+        t.stop();
+        keep(sum);
+    });
+}
+
+/* the controllers alternate between position, csl and impulse */
+result bench_execute_controller(options const& opt, unsigned n) {
+    loopback_bus bus;
+    std::vector<motor_t> motors;
+    for (unsigned i = 0; i < n; ++i) {
+        motors.emplace_back(i, bus);
+        motors[i].set_voltage_limit(0.5);
+        motors[i].set_controller_type(static_cast<motor_t::Controller_t>(motor_t::position + i % 3));
+        motors[i].set_target_position(0.25);
+    }
+    return measure(opt, n * steps_per_round, [&](section_timer& t) {
+        for (auto& m : motors) if (m.get_controller_type() == motor_t::impulse) m.apply_impulse(0.2, steps_per_round);
+        t.start();
+        for (unsigned k = 0; k < steps_per_round; ++k)
+            for (auto& m : motors) m.execute_controller();
+        t.stop();
+        keep(motors[0]);
+    });
+}
+
+/* one response per motor, received in one chunk, the requests are excluded from the timing,
+   the motorcord is kept for all runs, it reports disabling the motors when destroyed */
+result bench_decode(options const& opt, unsigned n, uint8_t cmd) {
+    static loopback_bus bus;
+    static cord_t cord(motorcord::max_boards, /*verbose=*/false, bus);
+    const std::vector<uint8_t> frames = responses(cmd, n);
+    return measure(opt, n, [&](section_timer& t) {
+        for (unsigned i = 0; i < n; ++i) {
+            if (cmd == 0xE1) cord[i].transmit_ping();
+            else cord[i].transmit(/*flush=*/false, /*poll_sensor=*/cmd == 0x41);
+        }
+        bus.send_msg();
+        bus.receive(frames);
+        t.start();
+        cord.receive_data();
+        t.stop();
+        bus.clear_received();
+    });
+}
+
+result bench_decode_0x80(options const& opt, unsigned n) { return bench_decode(opt, n, 0x80); }
+result bench_decode_0x41(options const& opt, unsigned n) { return bench_decode(opt, n, 0x41); }
+result bench_decode_0xE1(options const& opt, unsigned n) { return bench_decode(opt, n, 0xE1); }
+
+/* framing a voltage command per motor into the send queue, as the motors do */
+result bench_queue_enqueue(options const& opt, unsigned n) {
+    loopback_bus bus;
+    return measure(opt, n, [&](section_timer& t) {
+        t.start();
+        for (unsigned i = 0; i < n; ++i) {
+            const uint8_t frame[] = { 0xB0, static_cast<uint8_t>(i), 0x40 };
+            bus.enqueue_sync_bytes(0xFF);
+            bus.enqueue_bytes(frame, sizeof(frame));
+            bus.enqueue_checksum();
+        }
+        t.stop();
+        bus.send_msg();
+    });
+}
+
+/* consuming a state response per motor from the receive queue, frame by frame */
+result bench_queue_dequeue(options const& opt, unsigned n) {
+    loopback_bus bus;
+    const std::vector<uint8_t> frames = responses(0x80, n);
+    const std::size_t len = frames.size() / n;
+    return measure(opt, n, [&](section_timer& t) {
+        bus.receive(frames);
+        t.start();
+        for (unsigned i = 0; i < n; ++i) {
+            keep(bus.peek(len).data[2]);
+            bus.consume(len);
+        }
+        t.stop();
+        bus.reset_checksum();
+    });
+}
+
+struct benchmark {
+    const char* name;
+    result (*run)(options const&, unsigned);
+};
+
+const benchmark benchmarks[] = {
+    { "pid_step"          , bench_pid_step           },
+    { "csl_step"          , bench_csl_step           },
+    { "csl_update_mode"   , bench_csl_update_mode    },
+    { "impulse_step"      , bench_impulse_step       },
+    { "execute_controller", bench_execute_controller },
+    { "decode_0x80"       , bench_decode_0x80        },
+    { "decode_0x41"       , bench_decode_0x41        },
+    { "decode_0xE1"       , bench_decode_0xE1        },
+    { "queue_enqueue"     , bench_queue_enqueue      },
+    { "queue_dequeue"     , bench_queue_dequeue      },
+};
+
+/* reads the ns_per_op of a previous run by "bench motors" */
+bool read_baseline(const char* filename, std::map<std::string, double>& baseline)
+{
+    FILE* f = fopen(filename, "r");
+    if (f == NULL) { wrn_msg("Could not open baseline %s.", filename); return false; }
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        char name[64];
+        unsigned motors;
+        double ns;
+        if (sscanf(line, "bench=%63s motors=%u ns_per_op=%lf", name, &motors, &ns) == 3)
+            baseline[std::string(name) + " " + std::to_string(motors)] = ns;
+    }
+    fclose(f);
+    return true;
+}
+
+} /* namespace */
+
+int main(int argc, char* argv[])
+{
+    options o;
+    int c;
+    while ((c = getopt(argc, argv, "m:s:t:f:c:T:")) != -1) {
+        switch (c) {
+            case 'm': o.max_motors = std::min<unsigned>(motorcord::max_boards, atoi(optarg)); break;
+            case 's': o.samples    = std::max(1, atoi(optarg)); break;
+            case 't': o.sample_ms  = std::max(1, atoi(optarg)); break;
+            case 'f': o.filter     = optarg; break;
+            case 'c': o.baseline   = optarg; break;
+            case 'T': o.threshold  = atof(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-m max_motors] [-s samples] [-t sample_ms] [-f filter] "
+                                "[-c baseline_file] [-T threshold]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    std::map<std::string, double> baseline;
+    if (o.baseline != NULL and not read_baseline(o.baseline, baseline))
+        return EXIT_FAILURE;
+
+    calibrate();
+    printf("# timer_overhead_ns=%.1f timer_overhead_cycles=%.1f\n", overhead.ns, overhead.ticks);
+
+    unsigned regressions = 0;
+    for (auto const& b : benchmarks) {
+        if (o.filter != NULL and strstr(b.name, o.filter) == NULL) continue;
+        for (unsigned n = 1; n <= o.max_motors; n *= 2) {
+            const result r = b.run(o, n);
+            printf("bench=%s motors=%u ns_per_op=%.3f cycles_per_op=%.2f", b.name, n, r.ns_per_op, r.cycles_per_op);
+            auto it = baseline.find(std::string(b.name) + " " + std::to_string(n));
+            if (it != baseline.end() and it->second > .0) {
+                const double ratio = r.ns_per_op / it->second;
+                const bool regressed = ratio > 1.0 + o.threshold;
+                regressions += regressed;
+                printf(" baseline_ns_per_op=%.3f ratio=%.3f%s", it->second, ratio, regressed ? " regression=1" : "");
+            }
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+
+    if (o.baseline != NULL) {
+        printf("regressions=%u\n", regressions);
+        if (regressions > 0) return 2;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,145 @@
+#ifndef SUPREME_BUFFERED_COMMUNICATION_HPP
+#define SUPREME_BUFFERED_COMMUNICATION_HPP
+
+#include <atomic>
+#include <cassert>
+#include "common/log_messages.h"
+#include "common/ring_buffer.h"
+#include "communication_interface.hpp"
+#include "bus_capture.hpp"
+
+namespace supreme {
+
+/* Send and receive queues with their checksums, common to all transports.
+
+   Derived classes only move the bytes between the queues and the wire,
+   i.e. implement read_msg, send_msg and the waiting, and account the time
+   spent there in 'timing'. For each chunk of bytes written to the receive
+   queue, they call note_arrival from the same (producer) thread. If a
+   capture is set, they pass the bytes written and read to it.
+*/
+class buffered_communication : public communication_interface {
+protected:
+
+    static const std::size_t queue_size = 4096;
+
+    /* single-producer single-consumer, no locking required */
+    ring_buffer<uint8_t, queue_size> send_queue;
+    ring_buffer<uint8_t, queue_size> recv_queue;
+    uint8_t send_checksum = 0;
+    uint8_t recv_checksum = 0;
+
+    mutable io_timing timing;
+
+    bus_capture* capture = NULL;
+
+    /* arrival times of the received chunks, by absolute position of their end */
+    struct arrival {
+        uint64_t            end;
+        clock_t::time_point time;
+    };
+    ring_buffer<arrival, 256> arrivals;
+    std::atomic<uint64_t>     rx_total;     /* bytes written to the receive queue, producer */
+    uint64_t                  rx_consumed = 0; /* consumer */
+
+    /* producer side: the last 'len' bytes written to the receive queue arrived at 't' */
+    void note_arrival(std::size_t len, clock_t::time_point t) {
+        const uint64_t end = rx_total.load(std::memory_order_relaxed) + len;
+        arrivals.push({ end, t }); /* if full, the bytes are timestamped when read */
+        rx_total.store(end, std::memory_order_release);
+    }
+
+    /* consumer side: drops the arrivals of consumed bytes */
+    void advance(std::size_t len) {
+        rx_consumed += len;
+        while (not arrivals.empty() and arrivals.front().end <= rx_consumed)
+            arrivals.pop();
+    }
+
+    static uint64_t elapsed_ns(clock_t::time_point t0) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(clock_t::now() - t0).count();
+    }
+
+public:
+    buffered_communication() : send_queue(), recv_queue(), arrivals(), rx_total(0) {}
+
+    void enqueue_sync_bytes(uint8_t sync) {
+        enqueue_byte(sync);
+        enqueue_byte(sync);
+    }
+
+    void enqueue_byte(uint8_t byte) {
+        if (not send_queue.push(byte))
+            err_msg(__FILE__,__LINE__,"Buffer overflow.");
+        send_checksum += byte;
+    }
+
+    void enqueue_word(uint16_t word) {
+        enqueue_byte( (uint8_t) (word >> 8) ); // high byte
+        enqueue_byte( (uint8_t) (0x00ff & word) ); //  low byte
+    }
+
+    void enqueue_bytes(const uint8_t* bytes, std::size_t len) {
+        if (send_queue.write(bytes, len) != len)
+            err_msg(__FILE__,__LINE__,"Buffer overflow.");
+        for (std::size_t i = 0; i < len; ++i)
+            send_checksum += bytes[i];
+    }
+
+    void enqueue_checksum(void) {
+        send_queue.push(~send_checksum + 1);
+        send_checksum = 0;
+    }
+
+    bool       empty() const { return recv_queue.empty(); }
+    void         pop()       { recv_queue.pop(); advance(1); }
+    uint8_t    front() const { return recv_queue.front(); }
+    std::size_t size() const { return recv_queue.size();  }
+
+    byte_span peek(std::size_t len) const { return { recv_queue.peek(), std::min(len, recv_queue.size()) }; }
+
+    void consume(std::size_t len) {
+        const byte_span view = peek(len);
+        for (std::size_t i = 0; i < view.size; ++i)
+            recv_checksum += view[i];
+        recv_queue.consume(view.size);
+        advance(view.size);
+    }
+
+    clock_t::time_point arrival_time(std::size_t offset) const {
+        const uint64_t pos = rx_consumed + offset;
+        const arrival* a = arrivals.peek();
+        for (std::size_t i = 0, n = arrivals.size(); i < n; ++i)
+            if (a[i].end > pos) return a[i].time;
+        return clock_t::now();
+    }
+
+    uint8_t get_byte() {
+        assert(recv_queue.size() > 0);
+        uint8_t tmp = recv_queue.front();
+        recv_queue.pop();
+        advance(1);
+        recv_checksum += tmp;
+        return tmp;
+    }
+
+    uint16_t get_word() {
+        assert(recv_queue.size() > 1);
+        const byte_span view = peek(2);
+        const uint16_t word = view.word(0);
+        consume(2);
+        return word;
+    }
+
+    io_timing const& get_io_timing() const { return timing; }
+
+    /* sets the capture (not owned, may be NULL), which must be open */
+    void set_capture(bus_capture* c) { capture = c; }
+
+    bool is_checksum_ok() const { return (recv_checksum == 0); }
+    void reset_checksum() { recv_checksum = 0; }
+};
+
+} /* namespace supreme */
+
+#endif /* SUPREME_BUFFERED_COMMUNICATION_HPP */
@@ -0,0 +1,134 @@
+/*---------------------------------+
+ | Supreme Machines                |
+ | Sensorimotor C++ Library        |
+ | Matthias Kubisch                |
+ | kubisch@informatik.hu-berlin.de |
+ | November 2018                   |
+ +---------------------------------*/
+
+#ifndef SUPREME_BUS_CAPTURE_HPP
+#define SUPREME_BUS_CAPTURE_HPP
+
+#include <atomic>
+#include <cinttypes>
+#include <cstring>
+#include <mutex>
+
+#include "common/log_messages.h"
+#include "common/mapped_file.h"
+#include "communication_interface.hpp"
+
+namespace supreme {
+
+/* Captures the raw bytes written to and read from a transport, to be replayed by replay_bus.
+
+   Each write (send_msg) and each read returning data is stored as one chunk
+   in a preallocated memory-mapped file, as the telemetry_recorder, chunks
+   not fitting anymore are dropped and counted. Appending is serialized, as
+   the received bytes may come from a read-ahead thread.
+
+   File format, little-endian, all offsets in bytes:
+
+     header (32 bytes)
+        0  char[8]  magic "SMCAPTR1"
+        8  uint32   header size (32)
+       12  uint32   reserved
+       16  uint64   number of bytes used by the chunks
+       24  uint64   number of chunks dropped
+
+     chunks, starting at offset 32, each padded to a multiple of 8 bytes
+        0  uint64   timestamp, ns of the steady (monotonic) clock
+        8  uint32   length of the data
+       12  uint8    direction, 0: sent to the bus, 1: received from the bus
+       13  uint8[3] reserved
+       16  uint8    data[length]
+*/
+class bus_capture {
+public:
+
+    struct file_header {
+        char     magic[8];
+        uint32_t header_size;
+        uint32_t reserved;
+        uint64_t used;
+        uint64_t dropped;
+    };
+
+    struct chunk_header {
+        uint64_t timestamp_ns;
+        uint32_t length;
+        uint8_t  direction;
+        uint8_t  reserved[3];
+    };
+
+    static_assert(sizeof(file_header)  == 32, "Unexpected header layout.");
+    static_assert(sizeof(chunk_header) == 16, "Unexpected chunk layout.");
+
+    enum direction_t { sent = 0, received = 1 };
+
+    static std::size_t padded(std::size_t len) { return (len + 7) & ~std::size_t(7); }
+
+    bus_capture() : file() {}
+    ~bus_capture() { close(); }
+
+    bus_capture(bus_capture const&) = delete;
+    bus_capture& operator=(bus_capture const&) = delete;
+
+    /* creates the file with room for 'capacity' bytes of chunks */
+    bool open(const char* path, uint64_t capacity)
+    {
+        close();
+        std::lock_guard<std::mutex> lock(mtx);
+        if (not file.create(path, sizeof(file_header) + capacity)) return false;
+        header = reinterpret_cast<file_header*>(file.data());
+        std::memset(header, 0, sizeof(file_header));
+        std::memcpy(header->magic, "SMCAPTR1", 8);
+        header->header_size = sizeof(file_header);
+        sts_msg("Capturing bus traffic to %s, %" PRIu64 " bytes.", path, capacity);
+        return true;
+    }
+
+    /* flushes the mapping and truncates the file to the chunks written */
+    void close(void)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (not file.is_open()) return;
+        sts_msg("Bus capture stopped, %" PRIu64 " bytes, %" PRIu64 " chunks dropped.", header->used, header->dropped);
+        file.close(sizeof(file_header) + header->used);
+        header = NULL;
+    }
+
+    bool is_open(void) const { return file.is_open(); }
+
+    void append(direction_t dir, const uint8_t* data, std::size_t len)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (not file.is_open() or len == 0) return;
+        const std::size_t size = sizeof(chunk_header) + padded(len);
+        if (sizeof(file_header) + header->used + size > file.size()) {
+            ++header->dropped;
+            return;
+        }
+
+        uint8_t* p = file.data() + sizeof(file_header) + header->used;
+        chunk_header* ch = reinterpret_cast<chunk_header*>(p);
+        ch->timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               communication_interface::clock_t::now().time_since_epoch()).count();
+        ch->length = len;
+        ch->direction = dir;
+        std::memset(ch->reserved, 0, sizeof(ch->reserved));
+        std::memcpy(p + sizeof(chunk_header), data, len);
+
+        std::atomic_thread_fence(std::memory_order_release);
+        header->used += size;
+    }
+
+private:
+    mapped_file  file;
+    file_header* header = NULL;
+    std::mutex   mtx;
+};
+
+} /* namespace supreme */
+
+#endif /* SUPREME_BUS_CAPTURE_HPP */
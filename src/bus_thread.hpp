@@ -0,0 +1,284 @@
+/*---------------------------------+
+ | Supreme Machines                |
+ | Sensorimotor C++ Library        |
+ | Matthias Kubisch                |
+ | kubisch@informatik.hu-berlin.de |
+ | November 2018                   |
+ +---------------------------------*/
+
+#ifndef SUPREME_BUS_THREAD_HPP
+#define SUPREME_BUS_THREAD_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <mutex>
+#include <thread>
+
+#include "common/allocation_guard.h"
+#include "common/periodic_scheduler.h"
+#include "common/realtime.h"
+#include "common/triple_buffer.h"
+#include "motorcord.hpp"
+
+namespace supreme {
+
+/* setpoints of a single motor as written by the clients, events such as
+   impulses or limit changes are applied once, when their sequence number changes */
+struct motor_setpoint {
+    sensorimotor::Controller_t controller = sensorimotor::Controller_t::none;
+    double   target_position   = .0;
+    double   target_voltage    = .0;
+    double   Kp                = 0.8;
+    double   Ki                = .0;
+    double   csl_mode          = .0;
+    double   csl_fb            = 1.03;
+    double   lim_disable_lo    = -0.90;
+    double   lim_disable_hi    = +0.90;
+
+    double   voltage_limit     = .0;
+    unsigned voltage_limit_seq = 0;
+
+    double   impulse_value     = .0;
+    unsigned impulse_duration  = 0;
+    unsigned impulse_seq       = 0;
+};
+
+struct command_snapshot {
+    motor_setpoint motor[motorcord::max_boards];
+};
+
+struct state_snapshot {
+    uint64_t       cycle = 0;
+    uint64_t       timestamp_ns = 0; /* steady clock, end of the cycle's transactions */
+    std::size_t    num_motors = 0;
+    bool           active[motorcord::max_boards] = {};
+    interface_data motor[motorcord::max_boards];
+    cycle_timing   timing;
+
+    /* with deferred decoding, the reader converts the sensor words when reading the snapshot */
+    bool            deferred = false;
+    raw_sensor_data raw[motorcord::max_boards];
+};
+
+/* An endpoint for clients in other processes, see shared_state.hpp. The bus takes
+   the setpoints from it before and publishes the state to it after each cycle. */
+class bus_endpoint {
+public:
+    virtual ~bus_endpoint() {}
+
+    /* returns the setpoints if changed since the last call, else NULL */
+    virtual command_snapshot const* take_setpoints(void) = 0;
+
+    /* the sensors of the state are decoded */
+    virtual void publish(state_snapshot const& state) = 0;
+};
+
+
+/* Runs the bus cycles of a motorcord, optionally on a dedicated native thread.
+
+   Clients exchange data with the bus only through lock-free triple buffers:
+   setpoints are taken over at the beginning of each cycle and the state of
+   all motors is published at its end. The client mutex only serializes
+   concurrent clients, it is never taken by the bus.
+*/
+class bus_thread {
+
+    motorcord&         motors;
+    periodic_scheduler scheduler;
+
+    triple_buffer<command_snapshot> commands;
+    triple_buffer<state_snapshot>   states;
+
+    /* client side */
+    std::mutex       client_mtx;
+    command_snapshot client_commands;
+
+    /* bus side */
+    unsigned applied_limit_seq  [motorcord::max_boards] = {};
+    unsigned applied_impulse_seq[motorcord::max_boards] = {};
+    bus_endpoint* endpoint = NULL;
+    unsigned endpoint_limit_seq  [motorcord::max_boards] = {}; /* events are counted per source */
+    unsigned endpoint_impulse_seq[motorcord::max_boards] = {};
+    uint64_t cycles = 0;
+    unsigned slack_us = 0;
+
+    std::thread       thread;
+    std::atomic<bool> running;
+
+public:
+
+    bus_thread(motorcord& motors, uint64_t cycle_time_us)
+    : motors(motors)
+    , scheduler(cycle_time_us)
+    , commands()
+    , states()
+    , client_mtx()
+    , client_commands()
+    , thread()
+    , running(false)
+    {}
+
+    ~bus_thread() { stop(); }
+
+    /* starts the native bus thread, a priority > 0 selects SCHED_FIFO,
+       a cpu >= 0 pins the thread to that cpu */
+    bool start(int priority = 0, int cpu = -1) {
+        if (running) return false;
+        running = true;
+        scheduler.start();
+        thread = std::thread(&bus_thread::run, this);
+        if (priority > 0) set_realtime_priority(thread, priority);
+        if (cpu >= 0) set_cpu_affinity(thread, cpu);
+        sts_msg("Bus thread started.");
+        return true;
+    }
+
+    void stop(void) {
+        if (not running) return;
+        running = false;
+        thread.join();
+        sts_msg("Bus thread stopped after %" PRIu64 " cycles.", cycles);
+    }
+
+    bool is_running(void) const { return running; }
+
+    /* sets the endpoint (not owned, may be NULL) for clients of other processes, whose
+       setpoints are applied whenever they change, as are those of write_setpoints,
+       i.e. the last change wins (not thread-safe) */
+    void set_endpoint(bus_endpoint* e) {
+        endpoint = e;
+        std::fill(endpoint_limit_seq, endpoint_limit_seq + motorcord::max_boards, 0);
+        std::fill(endpoint_impulse_seq, endpoint_impulse_seq + motorcord::max_boards, 0);
+    }
+
+    /* sets how missed deadlines are handled, see periodic_scheduler (not thread-safe) */
+    void set_deadline_policy(periodic_scheduler::policy_t p) { scheduler.set_policy(p); }
+
+    /* performs one cycle and, if paced, waits for the next deadline while
+       discarding late bytes on the bus, returns false if writing to the bus failed */
+    bool execute_cycle(bool paced = true)
+    {
+        const bool sent = execute_transactions();
+        if (not paced) return sent;
+        allocation_guard guard;
+        const auto t0 = communication_interface::clock_t::now();
+        scheduler.wait([this](periodic_scheduler::clock_t::time_point deadline) { motors.idle_until(deadline); });
+        slack_us = sensorimotor::elapsed_us(t0, communication_interface::clock_t::now());
+        return sent;
+    }
+
+    /* client side: modifies the setpoints by calling f(command_snapshot&)
+       and publishes them for the next cycle */
+    template <typename Function>
+    void write_setpoints(Function f) {
+        std::lock_guard<std::mutex> lock(client_mtx);
+        f(client_commands);
+        commands.write_buffer() = client_commands;
+        commands.publish();
+    }
+
+    /* client side: calls f(const state_snapshot&) with the latest state, the
+       calibration of the motors must not be changed while the bus thread runs */
+    template <typename Function>
+    void read_state(Function f) {
+        std::lock_guard<std::mutex> lock(client_mtx);
+        states.update();
+        state_snapshot& state = states.read_buffer();
+        if (state.deferred) {
+            for (std::size_t i = 0; i < state.num_motors; ++i)
+                decode_sensors(state.raw[i], motors[i].get_calibration(), state.motor[i]);
+            state.deferred = false;
+        }
+        f(state);
+    }
+
+private:
+
+    void run(void) {
+        lock_thread_stack();
+        while (running)
+            execute_cycle();
+    }
+
+    bool execute_transactions(void)
+    {
+        {
+            allocation_guard guard;
+            if (commands.update())
+                apply_setpoints(commands.read_buffer(), applied_limit_seq, applied_impulse_seq);
+            if (endpoint)
+                if (command_snapshot const* cmd = endpoint->take_setpoints())
+                    apply_setpoints(*cmd, endpoint_limit_seq, endpoint_impulse_seq);
+        }
+        const bool sent = motors.execute_cycle(); /* guards itself */
+        ++cycles;
+
+        allocation_guard guard;
+        publish_state();
+        return sent;
+    }
+
+    /* the sequence numbers of the events last applied from the source of cmd */
+    void apply_setpoints(command_snapshot const& cmd, unsigned* limit_seq, unsigned* impulse_seq)
+    {
+        for (std::size_t i = 0; i < motors.size(); ++i) {
+            auto const& s = cmd.motor[i];
+            auto& m = motors[i];
+            m.set_controller_type(s.controller);
+            m.set_target_position(s.target_position);
+            m.set_proportional(s.Kp);
+            m.set_integral(s.Ki);
+            m.set_target_csl_mode(s.csl_mode);
+            m.set_target_csl_fb(s.csl_fb);
+            m.set_disable_position_limits(s.lim_disable_lo, s.lim_disable_hi);
+
+            if (limit_seq[i] != s.voltage_limit_seq) {
+                m.set_voltage_limit(s.voltage_limit);
+                limit_seq[i] = s.voltage_limit_seq;
+            }
+            if (s.controller == sensorimotor::Controller_t::voltage)
+                m.set_target_voltage(s.target_voltage);
+
+            if (impulse_seq[i] != s.impulse_seq) {
+                m.apply_impulse(s.impulse_value, s.impulse_duration);
+                impulse_seq[i] = s.impulse_seq;
+            }
+        }
+    }
+
+    void publish_state(void)
+    {
+        state_snapshot& state = states.write_buffer();
+        state.cycle = cycles;
+        state.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 communication_interface::clock_t::now().time_since_epoch()).count();
+        state.num_motors = motors.size();
+        state.deferred = motors.get_deferred_decoding();
+        for (std::size_t i = 0; i < motors.size(); ++i) {
+            state.active[i] = motors[i].is_active();
+            state.motor[i]  = motors[i].get_data();
+            if (state.deferred) state.raw[i] = motors[i].get_raw_data();
+        }
+        state.timing = motors.get_timing();
+        state.timing.slack_us = slack_us;
+        auto const& sched = scheduler.get_statistics();
+        state.timing.lateness_us = sched.lateness_ns / 1000;
+        state.timing.overruns    = sched.overruns;
+        state.timing.skipped     = sched.skipped;
+
+        if (endpoint) {
+            if (state.deferred) { /* the clients can't decode */
+                for (std::size_t i = 0; i < motors.size(); ++i)
+                    decode_sensors(state.raw[i], motors[i].get_calibration(), state.motor[i]);
+                state.deferred = false;
+            }
+            endpoint->publish(state);
+        }
+        states.publish();
+    }
+};
+
+} /* namespace supreme */
+
+#endif /* SUPREME_BUS_THREAD_HPP */
@@ -0,0 +1,70 @@
+/* allocation_guard.cpp */
+
+#include "allocation_guard.h"
+
+#ifdef SUPREME_TRAP_ALLOCATIONS
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <execinfo.h>
+#include <unistd.h>
+
+extern "C" {
+    void* __libc_malloc(size_t);
+    void* __libc_calloc(size_t, size_t);
+    void* __libc_realloc(void*, size_t);
+}
+
+namespace supreme {
+
+namespace {
+
+/* initial-exec, i.e. accessing it never allocates itself */
+__thread unsigned guard_depth __attribute__((tls_model("initial-exec"))) = 0;
+
+void check(const char* what) {
+    if (guard_depth == 0) return;
+    guard_depth = 0; /* reporting must not trap again */
+    const char msg[] = "\nERROR: heap allocation in a guarded scope, by ";
+    ssize_t res = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+    res = write(STDERR_FILENO, what, strlen(what));
+    res = write(STDERR_FILENO, "\n", 1);
+    (void) res;
+    void* frames[32];
+    backtrace_symbols_fd(frames, backtrace(frames, 32), STDERR_FILENO);
+    abort();
+}
+
+void* checked_new(std::size_t size, const char* what) {
+    check(what);
+    if (void* p = __libc_malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+} /* namespace */
+
+unsigned& allocation_guard::depth(void) { return guard_depth; }
+
+} /* namespace supreme */
+
+using supreme::check;
+using supreme::checked_new;
+
+void* operator new  (std::size_t size) { return checked_new(size, "operator new"); }
+void* operator new[](std::size_t size) { return checked_new(size, "operator new[]"); }
+void* operator new  (std::size_t size, std::nothrow_t const&) noexcept { check("operator new"); return __libc_malloc(size ? size : 1); }
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept { check("operator new[]"); return __libc_malloc(size ? size : 1); }
+
+void operator delete  (void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete  (void* p, std::nothrow_t const&) noexcept { free(p); }
+void operator delete[](void* p, std::nothrow_t const&) noexcept { free(p); }
+
+extern "C" {
+    void* malloc (size_t size)            { check("malloc");  return __libc_malloc(size); }
+    void* calloc (size_t n, size_t size)  { check("calloc");  return __libc_calloc(n, size); }
+    void* realloc(void* p, size_t size)   { check("realloc"); return __libc_realloc(p, size); }
+}
+
+#endif /* SUPREME_TRAP_ALLOCATIONS */
@@ -0,0 +1,40 @@
+/*---------------------------------+
+ | Supreme Machines                |
+ | Sensorimotor C++ Library        |
+ | Matthias Kubisch                |
+ | kubisch@informatik.hu-berlin.de |
+ | November 2018                   |
+ +---------------------------------*/
+
+#ifndef SUPREME_ALLOCATION_GUARD_HPP
+#define SUPREME_ALLOCATION_GUARD_HPP
+
+namespace supreme {
+
+/* Marks a scope of the calling thread, in which nothing must be allocated on
+   the heap, e.g. a bus cycle. Built with SUPREME_TRAP_ALLOCATIONS defined
+   (scons trap_allocations=1), common/allocation_guard.cpp replaces operator
+   new and malloc, which then abort the program on any allocation inside a
+   guarded scope, printing a backtrace (link with -rdynamic for the names of
+   the functions). Otherwise the guard does nothing.
+
+   Within the python module only the C++ allocations of the library are
+   trapped, malloc of the C library is bound to the interpreter's already. */
+class allocation_guard {
+public:
+#ifdef SUPREME_TRAP_ALLOCATIONS
+    allocation_guard() { ++depth(); }
+   ~allocation_guard() { --depth(); }
+
+    static unsigned& depth(void); /* of the calling thread */
+#else
+    allocation_guard() {}
+#endif
+
+    allocation_guard(allocation_guard const&) = delete;
+    allocation_guard& operator=(allocation_guard const&) = delete;
+};
+
+} /* namespace supreme */
+
+#endif /* SUPREME_ALLOCATION_GUARD_HPP */
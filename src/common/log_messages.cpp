@@ -1,6 +1,13 @@
 /* log_messages.cpp */
 #include "log_messages.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
 #define KNRM  "\x1B[0m"
 #define KRED  "\x1B[31m"
 #define KGRN  "\x1B[32m"
@@ -10,13 +17,205 @@
 #define KCYN  "\x1B[36m"
 #define KWHT  "\x1B[37m"
 
+const unsigned cycle_log::max_motors; /* bound to references by std::min */
+
+namespace {
+
+struct log_record {
+    enum kind_t { status, debug, warning, cycle };
+    static const std::size_t text_size = 256;
+
+    kind_t        kind;
+    unsigned long number; /* of warnings */
+    union {
+        char      text[text_size];
+        cycle_log line;
+    };
+};
+
+/* bounded multi-producer single-consumer queue (D. Vyukov), producers claim a cell
+   with one CAS and never wait, a full queue drops the record */
+class record_queue {
+public:
+    static const std::size_t capacity = 256; /* power of 2 */
+
+    record_queue() : head(0), tail(0) {
+        for (std::size_t i = 0; i < capacity; ++i) cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    template <typename Fill>
+    bool push(Fill fill) {
+        std::size_t pos = head.load(std::memory_order_relaxed);
+        for (;;) {
+            cell& c = cells[pos & (capacity - 1)];
+            const std::size_t seq = c.seq.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    fill(c.record);
+                    c.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) return false; /* full */
+            else pos = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    /* consumer only */
+    template <typename Process>
+    bool pop(Process process) {
+        cell& c = cells[tail & (capacity - 1)];
+        if (c.seq.load(std::memory_order_acquire) != tail + 1) return false;
+        process(c.record);
+        c.seq.store(tail + capacity, std::memory_order_release);
+        ++tail;
+        return true;
+    }
+
+private:
+    struct cell {
+        std::atomic<std::size_t> seq;
+        log_record               record;
+    };
+    cell cells[capacity];
+    std::atomic<std::size_t> head;
+    std::size_t              tail;
+};
+
+void print_cycle(cycle_log const& line) {
+    printf("%02lu | ", static_cast<unsigned long>(line.cycle % 100));
+    for (uint32_t i = 0; i < std::min<uint32_t>(line.count, cycle_log::max_motors); ++i) {
+        cycle_log::entry const& e = line.motor[i];
+        if (!e.faulted)
+            printf("%u:%02u ", e.id, e.value);
+        else
+            printf("%u:_%u ", e.id, e.value);
+    }
+    printf("| e=%u t=%u\n", line.errors, line.timeouts);
+}
+
+void print_record(log_record const& r) {
+    switch (r.kind) {
+        case log_record::status : printf("%s\n", r.text); break;
+        case log_record::debug  : printf("%s‹dbg›%s %s\n", KGRN, KNRM, r.text); break;
+        case log_record::warning: printf("%sWARNING %ld: %s%s\n", KYEL, r.number, KNRM, r.text); break;
+        case log_record::cycle  : print_cycle(r.line); break;
+    }
+}
+
+/* writes the queued records in the background, limits the rate by token buckets,
+   one for the messages and one for the cycle lines, so these don't crowd out the former */
+class async_logger {
+public:
+    async_logger() : users(0), running(false), dropped(0), rate(200), burst(200) {}
+    ~async_logger() { stop(true); }
+
+    bool is_enabled(void) const { return running.load(std::memory_order_acquire); }
+
+    void start(void) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (users++ > 0) return;
+        fflush(stdout);
+        running = true;
+        drainer = std::thread(&async_logger::drain, this);
+    }
+
+    /* the last user stops the drainer, forced by err_msg and on exit */
+    void stop(bool force = false) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (users == 0 or (--users > 0 and not force)) return;
+        users = 0;
+        running = false;
+        if (drainer.joinable()) drainer.join();
+        while (queue.pop(print_record)) {}
+        report_suppressed();
+        fflush(stdout);
+    }
+
+    void set_rate_limit(unsigned lines_per_s, unsigned max_burst) {
+        rate = lines_per_s;
+        burst = std::max(1u, max_burst);
+    }
+
+    template <typename Fill>
+    void push(Fill fill) {
+        if (not queue.push(fill)) dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+private:
+    typedef std::chrono::steady_clock clock_t;
+    static const unsigned poll_interval_ms = 5;
+
+    void drain(void) {
+        double tokens[2] = { static_cast<double>(burst), static_cast<double>(burst) };
+        auto last = clock_t::now();
+        auto last_report = last;
+        while (running.load(std::memory_order_acquire)) {
+            const auto now = clock_t::now();
+            const unsigned r = rate;
+            for (double& t : tokens)
+                t = std::min<double>(burst, t + std::chrono::duration<double>(now - last).count() * r);
+            last = now;
+
+            bool written = false;
+            while (queue.pop([&](log_record const& rec) {
+                double& t = tokens[rec.kind == log_record::cycle ? 1 : 0];
+                if (r == 0 or t >= 1.0) { print_record(rec); t -= 1.0; written = true; }
+                else dropped.fetch_add(1, std::memory_order_relaxed);
+            })) {}
+
+            if (now - last_report >= std::chrono::seconds(1)) {
+                written |= report_suppressed();
+                last_report = now;
+            }
+            if (written) fflush(stdout);
+            std::this_thread::sleep_for(std::chrono::milliseconds(poll_interval_ms));
+        }
+    }
+
+    bool report_suppressed(void) {
+        const unsigned long n = dropped.exchange(0, std::memory_order_relaxed);
+        if (n > 0) printf("%s[%lu log lines suppressed]%s\n", KWHT, n, KNRM);
+        return n > 0;
+    }
+
+    std::mutex                 mtx;
+    unsigned                   users;
+    std::atomic<bool>          running;
+    std::thread                drainer;
+    record_queue               queue;
+    std::atomic<unsigned long> dropped;
+    std::atomic<unsigned>      rate;
+    std::atomic<unsigned>      burst;
+};
+
+const unsigned async_logger::poll_interval_ms;
+
+async_logger logger;
+std::atomic<unsigned long> wrn_msg_cnt(0);
+
+void queue_text(log_record::kind_t kind, unsigned long number, const char* format, va_list args) {
+    logger.push([&](log_record& r) {
+        r.kind = kind;
+        r.number = number;
+        vsnprintf(r.text, log_record::text_size, format, args);
+    });
+}
+
+} /* namespace */
+
 void
 sts_msg(const char* format, ...)
 {
     va_list args;
     va_start(args, format);
-    vprintf(format, args);
-    printf("\n");
+    if (logger.is_enabled())
+        queue_text(log_record::status, 0, format, args);
+    else {
+        vprintf(format, args);
+        printf("\n");
+    }
     va_end(args);
 }
 
@@ -25,21 +224,29 @@ dbg_msg(const char* format, ...)
 {
     va_list args;
     va_start(args, format);
-    printf("%s‹dbg›%s ", KGRN, KNRM);
-    vprintf(format, args);
-    printf("\n");
+    if (logger.is_enabled())
+        queue_text(log_record::debug, 0, format, args);
+    else {
+        printf("%s‹dbg›%s ", KGRN, KNRM);
+        vprintf(format, args);
+        printf("\n");
+    }
     va_end(args);
 }
 
 void
 wrn_msg(const char* format, ...)
 {
-    static unsigned long wrn_msg_cnt = 0;
+    const unsigned long number = ++wrn_msg_cnt;
     va_list args;
     va_start(args, format);
-    printf("%sWARNING %ld: %s", KYEL, ++wrn_msg_cnt, KNRM);
-    vprintf(format, args);
-    printf("\n");
+    if (logger.is_enabled())
+        queue_text(log_record::warning, number, format, args);
+    else {
+        printf("%sWARNING %ld: %s", KYEL, number, KNRM);
+        vprintf(format, args);
+        printf("\n");
+    }
     va_end(args);
 }
 
@@ -47,6 +254,7 @@ void
 err_msg(const char* file, unsigned int line, const char* format, ...)
 {
     static unsigned long err_msg_cnt = 0;
+    logger.stop(true); /* flush what was queued before */
     va_list args;
     va_start(args, format);
     printf("%sERROR %ld:%s ", KRED, ++err_msg_cnt, KNRM);
@@ -56,3 +264,23 @@ err_msg(const char* file, unsigned int line, const char* format, ...)
     exit(EXIT_FAILURE);
 }
 
+void
+log_cycle(cycle_log const& line)
+{
+    if (logger.is_enabled())
+        logger.push([&](log_record& r) {
+            r.kind = log_record::cycle;
+            r.line.cycle    = line.cycle;
+            r.line.errors   = line.errors;
+            r.line.timeouts = line.timeouts;
+            r.line.count    = std::min<uint32_t>(line.count, cycle_log::max_motors);
+            std::copy(line.motor, line.motor + r.line.count, r.line.motor);
+        });
+    else
+        print_cycle(line);
+}
+
+void log_start_async(void) { logger.start(); }
+void log_stop_async (void) { logger.stop(); }
+
+void log_set_rate_limit(unsigned lines_per_s, unsigned burst) { logger.set_rate_limit(lines_per_s, burst); }
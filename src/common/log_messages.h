@@ -4,10 +4,36 @@
 #include <cstdlib>
 #include <cstdio>
 #include <cstdarg>
+#include <cstdint>
 
 void sts_msg(const char* format, ...);
 void dbg_msg(const char* format, ...);
 void wrn_msg(const char* format, ...);
 void err_msg(const char* file, unsigned int line, const char* format, ...);
 
+/* the line of a bus cycle in verbose mode, passed in binary and formatted by the
+   logger as "cc | id:response_us ... | e=errors t=timeouts", faulted motors as "id:_syncstate" */
+struct cycle_log {
+    static const unsigned max_motors = 128;
+    struct entry { uint8_t id; uint8_t faulted; uint16_t value; };
+
+    uint64_t cycle;
+    uint32_t errors;
+    uint32_t timeouts;
+    uint32_t count;
+    entry    motor[max_motors];
+};
+
+void log_cycle(cycle_log const& line);
+
+/* Asynchronous mode: the messages are queued without blocking, in a lock-free
+   queue of fixed size, and written by a background thread, at most the rate limit
+   of lines per second, for the messages and the cycle lines each. Lines exceeding
+   the rate or the queue are dropped and reported as suppressed, once a second.
+   Starting and stopping nests, the last stop flushes the queue. err_msg flushes
+   the queue before printing. */
+void log_start_async(void);
+void log_stop_async(void);
+void log_set_rate_limit(unsigned lines_per_s, unsigned burst); /* 0 lines_per_s: unlimited */
+
 #endif // LOG_MESSAGES_H
@@ -0,0 +1,90 @@
+/*---------------------------------+
+ | Supreme Machines                |
+ | Sensorimotor C++ Library        |
+ | Matthias Kubisch                |
+ | kubisch@informatik.hu-berlin.de |
+ | November 2018                   |
+ +---------------------------------*/
+
+#ifndef SUPREME_MAPPED_FILE_HPP
+#define SUPREME_MAPPED_FILE_HPP
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <cstdint>
+#include <cstddef>
+
+#include "log_messages.h"
+
+namespace supreme {
+
+/* A file of fixed size created and mapped as a whole for writing.
+
+   The blocks are allocated when created, so writing to the mapping does
+   not allocate on disk and cannot fail for lack of space. It is not free of
+   stalls though: the first write to each page takes a page fault, and writes
+   may wait while the kernel throttles or writes back the dirty pages. The
+   mapping is not locked, so a large file does not pin its size in RAM, see
+   lock_memory.
+*/
+class mapped_file {
+    int         fd   = -1;
+    uint8_t*    base = NULL;
+    std::size_t len  = 0;
+
+public:
+    mapped_file() {}
+    ~mapped_file() { close(len); }
+
+    mapped_file(mapped_file const&) = delete;
+    mapped_file& operator=(mapped_file const&) = delete;
+
+    bool create(const char* path, std::size_t size)
+    {
+        close(len);
+        fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) { wrn_msg("Could not create file %s.", path); return false; }
+
+        if (posix_fallocate(fd, 0, size) != 0) {
+            wrn_msg("Could not allocate %zu bytes for file %s.", size, path);
+            ::close(fd); fd = -1;
+            return false;
+        }
+
+        void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            wrn_msg("Could not map file %s.", path);
+            ::close(fd); fd = -1;
+            return false;
+        }
+        madvise(p, size, MADV_SEQUENTIAL);
+        munlock(p, size); /* in case the process locked all future mappings */
+        base = static_cast<uint8_t*>(p);
+        len = size;
+        return true;
+    }
+
+    /* flushes and unmaps the file, truncating it to 'final_size' bytes if smaller */
+    void close(std::size_t final_size)
+    {
+        if (fd < 0) return;
+        msync(base, len, MS_SYNC);
+        munmap(base, len);
+        if (final_size < len and ftruncate(fd, final_size) != 0)
+            wrn_msg("Could not truncate mapped file.");
+        ::close(fd);
+        fd = -1;
+        base = NULL;
+        len = 0;
+    }
+
+    bool is_open(void) const { return fd >= 0; }
+
+    uint8_t*    data(void) const { return base; }
+    std::size_t size(void) const { return len; }
+};
+
+} /* namespace supreme */
+
+#endif /* SUPREME_MAPPED_FILE_HPP */
@@ -0,0 +1,113 @@
+/*---------------------------------+
+ | Supreme Machines                |
+ | Sensorimotor C++ Library        |
+ | Matthias Kubisch                |
+ | kubisch@informatik.hu-berlin.de |
+ | November 2018                   |
+ +---------------------------------*/
+
+#ifndef SUPREME_PERIODIC_SCHEDULER_HPP
+#define SUPREME_PERIODIC_SCHEDULER_HPP
+
+#include <time.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+
+namespace supreme {
+
+/* Wakes up a periodic loop at absolute deadlines of the monotonic clock.
+
+   The deadlines are multiples of the period after start(), independent of
+   when the previous wake-up actually happened, so lateness does not add up
+   and the average rate does not drift. The final sleep is done by
+   clock_nanosleep(TIMER_ABSTIME).
+
+   A period whose work ends after its deadline is an overrun. With the skip
+   policy (default) the missed deadlines are dropped and the loop continues at
+   the next deadline in the future, keeping the phase. With catch_up all
+   deadlines are kept, so after a stall the missed periods are run back to back
+   until the schedule is met again, keeping the number of periods.
+
+   steady_clock is CLOCK_MONOTONIC with libstdc++ and libc++ on Linux,
+   so the deadlines can be passed to functions waiting on steady_clock.
+*/
+class periodic_scheduler {
+public:
+    typedef std::chrono::steady_clock clock_t;
+
+    enum policy_t { skip = 0, catch_up = 1 };
+
+    struct statistics {
+        uint64_t periods      = 0; /* wake-ups */
+        uint64_t overruns     = 0; /* periods ending after their deadline */
+        uint64_t skipped      = 0; /* deadlines dropped by the skip policy */
+        uint64_t lateness_ns  = 0; /* of the last wake-up after its deadline */
+        uint64_t max_lateness_ns = 0;
+    };
+
+    explicit periodic_scheduler(uint64_t period_us, policy_t policy = skip)
+    : period(std::chrono::microseconds(std::max<uint64_t>(1, period_us)))
+    , policy(policy)
+    , deadline(clock_t::now() + period)
+    {}
+
+    /* restarts the schedule, the next deadline is one period from now */
+    void start(void) { deadline = clock_t::now() + period; }
+
+    void set_policy(policy_t p) { policy = p; }
+    policy_t get_policy(void) const { return policy; }
+
+    uint64_t get_period_us(void) const { return std::chrono::duration_cast<std::chrono::microseconds>(period).count(); }
+
+    clock_t::time_point next_deadline(void) const { return deadline; }
+
+    statistics const& get_statistics(void) const { return stats; }
+
+    /* waits for the next deadline, calls idle(deadline) first if there is time left,
+       which may return early, e.g. to do something useful while waiting */
+    template <typename Function>
+    void wait(Function idle)
+    {
+        const auto now = clock_t::now();
+        if (now >= deadline) {
+            ++stats.overruns;
+            if (policy == skip) {
+                const uint64_t missed = (now - deadline) / period;
+                stats.skipped += missed;
+                deadline += (missed + 1) * period;
+            }
+        }
+        if (clock_t::now() < deadline)
+            idle(deadline);
+
+        sleep_until(deadline);
+        const auto woken = clock_t::now();
+        stats.lateness_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(woken - deadline).count();
+        stats.max_lateness_ns = std::max(stats.max_lateness_ns, stats.lateness_ns);
+        ++stats.periods;
+        deadline += period;
+    }
+
+    void wait(void) { wait([](clock_t::time_point) {}); }
+
+private:
+
+    static void sleep_until(clock_t::time_point t) {
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+        struct timespec ts;
+        ts.tv_sec  = ns / 1000000000;
+        ts.tv_nsec = ns % 1000000000;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+    }
+
+    clock_t::duration   period;
+    policy_t            policy;
+    clock_t::time_point deadline;
+    statistics          stats;
+};
+
+} /* namespace supreme */
+
+#endif /* SUPREME_PERIODIC_SCHEDULER_HPP */
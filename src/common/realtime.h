@@ -0,0 +1,87 @@
+/*---------------------------------+
+ | Supreme Machines                |
+ | Sensorimotor C++ Library        |
+ | Matthias Kubisch                |
+ | kubisch@informatik.hu-berlin.de |
+ | November 2018                   |
+ +---------------------------------*/
+
+#ifndef SUPREME_REALTIME_HPP
+#define SUPREME_REALTIME_HPP
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <thread>
+#include "log_messages.h"
+
+namespace supreme {
+
+/* switches the thread to SCHED_FIFO with the given priority (1..99),
+   requires CAP_SYS_NICE or an appropriate rtprio limit */
+inline bool set_realtime_priority(std::thread& thread, int priority) {
+    struct sched_param param;
+    param.sched_priority = priority;
+    const int res = pthread_setschedparam(thread.native_handle(), SCHED_FIFO, &param);
+    if (res != 0)
+        wrn_msg("Could not set real-time priority %d: %s", priority, strerror(res));
+    return res == 0;
+}
+
+/* pins the thread to the given cpu */
+inline bool set_cpu_affinity(std::thread& thread, int cpu) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    const int res = pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpuset);
+    if (res != 0)
+        wrn_msg("Could not set cpu affinity to cpu %d: %s", cpu, strerror(res));
+    return res == 0;
+}
+
+/* set by lock_memory, the threads started later lock their stacks then */
+inline std::atomic<bool>& memory_locked(void) { static std::atomic<bool> locked(false); return locked; }
+
+/* touches and locks the next pages of the calling thread's stack, so they
+   are mapped before they are needed and stay resident */
+inline void __attribute__((noinline)) lock_stack(void) {
+    const std::size_t size = 256*1024;
+    unsigned char stack[size];
+    volatile unsigned char* page = stack;
+    for (std::size_t i = 0; i < size; i += 4096) page[i] = 0;
+    if (mlock(stack, size) != 0)
+        wrn_msg("Could not lock stack: %s", strerror(errno));
+}
+
+/* locks the pages of a structure mapped after lock_memory, if memory is locked */
+inline void lock_region(const void* addr, std::size_t len) {
+    if (memory_locked() and mlock(addr, len) != 0)
+        wrn_msg("Could not lock %zu bytes: %s", len, strerror(errno));
+}
+
+/* Locks the current pages of the process into memory, i.e. the motor cord and
+   the buffers of the bus, so the bus cycles are not stalled by page faults.
+   Pages mapped later are not locked, so recording to a mapped file does not
+   pin its size in RAM; the stacks of the bus and receive threads started later
+   and the shared state of a server are locked explicitly. Call before starting
+   the threads. Requires CAP_IPC_LOCK or an appropriate memlock limit. */
+inline bool lock_memory(void) {
+    if (mlockall(MCL_CURRENT) != 0) {
+        wrn_msg("Could not lock memory: %s", strerror(errno));
+        return false;
+    }
+    memory_locked() = true;
+    lock_stack();
+    return true;
+}
+
+/* called by a real-time thread when started */
+inline void lock_thread_stack(void) { if (memory_locked()) lock_stack(); }
+
+} /* namespace supreme */
+
+#endif /* SUPREME_REALTIME_HPP */
@@ -0,0 +1,93 @@
+/*---------------------------------+
+ | Supreme Machines                |
+ | Sensorimotor C++ Library        |
+ | Matthias Kubisch                |
+ | kubisch@informatik.hu-berlin.de |
+ | November 2018                   |
+ +---------------------------------*/
+
+#ifndef SUPREME_RING_BUFFER_HPP
+#define SUPREME_RING_BUFFER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <algorithm>
+
+namespace supreme {
+
+/* Lock-free, fixed-capacity single-producer single-consumer ring buffer.
+
+   The storage is mirrored, i.e. each element is written twice, at index i
+   and i + Capacity. Therefore any range of up to Capacity elements starting
+   at the read position is contiguous in memory and can be accessed via
+   peek() without copying, regardless of the wrap-around.
+
+   Producer side: push(), write(), space()
+   Consumer side: front(), pop(), peek(), consume(), clear()
+   size() and empty() may be called from both sides.
+*/
+template <typename T, std::size_t Capacity>
+class ring_buffer {
+    static_assert(Capacity > 0 and (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two.");
+
+    static const std::size_t mask = Capacity - 1;
+
+    T buffer[2*Capacity];
+    std::atomic<std::size_t> head; /* written by producer */
+    std::atomic<std::size_t> tail; /* written by consumer */
+
+    void put(std::size_t index, const T& value) {
+        buffer[index & mask] = value;
+        buffer[(index & mask) + Capacity] = value;
+    }
+
+public:
+    ring_buffer() : buffer(), head(0), tail(0) {}
+
+    static constexpr std::size_t capacity(void) { return Capacity; }
+
+    std::size_t size(void) const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+    std::size_t space(void) const { return Capacity - size(); }
+    bool       empty(void) const { return size() == 0; }
+
+    bool push(const T& value) {
+        const std::size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= Capacity) return false;
+        put(h, value);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* appends up to len elements, returns the number of elements written */
+    std::size_t write(const T* src, std::size_t len) {
+        const std::size_t h = head.load(std::memory_order_relaxed);
+        len = std::min(len, Capacity - (h - tail.load(std::memory_order_acquire)));
+        const std::size_t pos = h & mask;
+        const std::size_t first = std::min(len, Capacity - pos);
+        std::copy(src, src + first, buffer + pos);
+        std::copy(src, src + first, buffer + pos + Capacity);
+        std::copy(src + first, src + len, buffer);
+        std::copy(src + first, src + len, buffer + Capacity);
+        head.store(h + len, std::memory_order_release);
+        return len;
+    }
+
+    const T& front(void) const { return buffer[tail.load(std::memory_order_relaxed) & mask]; }
+
+    void pop(void) { consume(1); }
+
+    /* returns a pointer to the contiguous range of size() elements at the read position */
+    const T* peek(void) const { return buffer + (tail.load(std::memory_order_relaxed) & mask); }
+
+    /* removes len elements from the read position */
+    void consume(std::size_t len) {
+        const std::size_t t = tail.load(std::memory_order_relaxed);
+        tail.store(t + std::min(len, head.load(std::memory_order_acquire) - t), std::memory_order_release);
+    }
+
+    void clear(void) { tail.store(head.load(std::memory_order_acquire), std::memory_order_release); }
+};
+
+} /* namespace supreme */
+
+#endif /* SUPREME_RING_BUFFER_HPP */
@@ -0,0 +1,128 @@
+/* serial_port.cpp */
+
+/* The kernel's termios2 (asm/termbits.h) conflicts with the one of glibc (termios.h),
+   hence this is kept in a translation unit of its own. */
+#include <asm/termbits.h>
+#include <linux/serial.h>
+#include <sys/ioctl.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+
+#include "serial_port.h"
+#include "log_messages.h"
+
+namespace supreme {
+
+namespace {
+
+/* /sys/bus/usb-serial/devices/ttyUSBx/latency_timer, resolving symlinks like /dev/serial/by-id/... */
+std::string latency_timer_file(std::string const& path) {
+    char real[PATH_MAX];
+    if (realpath(path.c_str(), real) == NULL) return std::string();
+    const char* name = strrchr(real, '/');
+    return std::string("/sys/bus/usb-serial/devices/") + (name ? name + 1 : real) + "/latency_timer";
+}
+
+bool set_baudrate(int fd, unsigned baudrate) {
+    struct termios2 tio;
+    if (ioctl(fd, TCGETS2, &tio) != 0) return false;
+    tio.c_cflag = CS8 | CLOCAL | CREAD | BOTHER | (BOTHER << IBSHIFT);
+    tio.c_iflag = IGNPAR;
+    tio.c_oflag = 0;
+    tio.c_lflag = 0;
+    tio.c_cc[VMIN]  = 0; /* reads return immediately */
+    tio.c_cc[VTIME] = 0;
+    tio.c_ispeed = tio.c_ospeed = baudrate;
+    if (ioctl(fd, TCSETS2, &tio) != 0) return false;
+
+    /* the driver stores the rate it actually achieves */
+    if (ioctl(fd, TCGETS2, &tio) == 0 and tio.c_ospeed != baudrate)
+        wrn_msg("Baud rate %u set as %u.", baudrate, tio.c_ospeed);
+    return true;
+}
+
+} /* namespace */
+
+std::string serial_device_path(std::string const& name) {
+    return (name.find('/') == std::string::npos) ? "/dev/" + name : name;
+}
+
+bool set_low_latency(int fd, bool enable) {
+    struct serial_struct serial;
+    if (ioctl(fd, TIOCGSERIAL, &serial) != 0) return false;
+    if (enable) serial.flags |=  ASYNC_LOW_LATENCY;
+    else        serial.flags &= ~ASYNC_LOW_LATENCY;
+    return ioctl(fd, TIOCSSERIAL, &serial) == 0;
+}
+
+int set_latency_timer(std::string const& path, unsigned ms) {
+    const std::string file = latency_timer_file(path);
+    if (file.empty()) return -1;
+
+    int previous = -1;
+    std::ifstream in(file.c_str());
+    if (not (in >> previous)) return -1; /* not a usb-serial adapter with latency timer */
+    in.close();
+    if (previous == static_cast<int>(ms)) return previous;
+
+    std::ofstream out(file.c_str());
+    if (not (out << ms << std::endl)) {
+        wrn_msg("Could not write %s (%s), requires write access, e.g. by a udev rule.", file.c_str(), strerror(errno));
+        return -1;
+    }
+    return previous;
+}
+
+int open_serial_port(std::string const& path, unsigned baudrate, serial_options const& options, int& latency_timer_restore)
+{
+    latency_timer_restore = -1;
+
+    const int fd = open(path.c_str(), O_RDWR | O_NOCTTY | O_NDELAY);
+    if (fd == -1) return -1;
+
+    /* lock access so that another process can't also use the port */
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        wrn_msg("Device %s is locked by another process.", path.c_str());
+        close(fd);
+        return -1;
+    }
+
+    if (not set_baudrate(fd, baudrate)) {
+        wrn_msg("Could not set %u baud on %s: %s", baudrate, path.c_str(), strerror(errno));
+        flock(fd, LOCK_UN);
+        close(fd);
+        return -1;
+    }
+
+    /* not supported by all devices, e.g. ptys */
+    const int lines = TIOCM_DTR | TIOCM_RTS;
+    ioctl(fd, TIOCMBIS, &lines);
+
+    if (options.low_latency and not set_low_latency(fd, true))
+        wrn_msg("Could not set low latency mode of %s.", path.c_str());
+
+    if (options.latency_timer_ms >= 0) {
+        const int previous = set_latency_timer(path, options.latency_timer_ms);
+        if (previous >= 0 and previous != options.latency_timer_ms) {
+            latency_timer_restore = previous;
+            sts_msg("Latency timer of %s set from %d ms to %d ms.", path.c_str(), previous, options.latency_timer_ms);
+        }
+    }
+    return fd;
+}
+
+void close_serial_port(int fd, std::string const& path, int latency_timer_restore)
+{
+    if (fd < 0) return;
+    if (latency_timer_restore >= 0) set_latency_timer(path, latency_timer_restore);
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+} /* namespace supreme */
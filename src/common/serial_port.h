@@ -0,0 +1,46 @@
+/*---------------------------------+
+ | Supreme Machines                |
+ | Sensorimotor C++ Library        |
+ | Matthias Kubisch                |
+ | kubisch@informatik.hu-berlin.de |
+ | November 2018                   |
+ +---------------------------------*/
+
+#ifndef SUPREME_SERIAL_PORT_HPP
+#define SUPREME_SERIAL_PORT_HPP
+
+#include <string>
+
+namespace supreme {
+
+/* settings applied when opening a serial device */
+struct serial_options {
+    std::string device;               /* name ("ttyUSB0") or path, e.g. below /dev/serial/by-id/,
+                                         empty tries ttyUSB1, then ttyUSB0 */
+    unsigned    baudrate = 0;         /* any rate the adapter supports, 0 for the default of the transport */
+    bool        low_latency = true;   /* sets ASYNC_LOW_LATENCY, the driver pushes bytes without delay */
+    int         latency_timer_ms = 1; /* of FTDI adapters (default 16 ms), < 0 leaves it unchanged */
+};
+
+/* returns the path of a device name, names without a '/' are looked up in /dev */
+std::string serial_device_path(std::string const& name);
+
+/* Opens the device raw (8N1, no flow control, non-blocking reads) at the given
+   rate, which is set with termios2/BOTHER, so rates besides the standard
+   table, e.g. 2 or 3 Mbaud, work with adapters supporting them. Locks the
+   device and applies the low latency settings, failing to apply those is
+   not fatal. The previous latency timer is stored to latency_timer_restore
+   for close_serial_port, -1 if it was not changed.
+   Returns the file descriptor or -1. */
+int open_serial_port(std::string const& path, unsigned baudrate, serial_options const& options, int& latency_timer_restore);
+
+void close_serial_port(int fd, std::string const& path, int latency_timer_restore);
+
+/* the latency timer of the usb-serial adapter behind the device, returns the previous value or -1 */
+int set_latency_timer(std::string const& path, unsigned ms);
+
+bool set_low_latency(int fd, bool enable);
+
+} /* namespace supreme */
+
+#endif /* SUPREME_SERIAL_PORT_HPP */
@@ -0,0 +1,120 @@
+/*---------------------------------+
+ | Supreme Machines                |
+ | Sensorimotor C++ Library        |
+ | Matthias Kubisch                |
+ | kubisch@informatik.hu-berlin.de |
+ | November 2018                   |
+ +---------------------------------*/
+
+#ifndef SUPREME_SHARED_MEMORY_HPP
+#define SUPREME_SHARED_MEMORY_HPP
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+#include "log_messages.h"
+#include "realtime.h"
+
+namespace supreme {
+
+/* A POSIX shared memory object (below /dev/shm), mapped as a whole.
+
+   The creator sets the size and the permissions, which decide who may map
+   the segment for reading or writing, independent of the umask. The pages
+   are touched when created, so that accessing them later does not fault,
+   and locked if the memory of the process is locked, see lock_memory.
+*/
+class shared_memory {
+    int         fd   = -1;
+    uint8_t*    base = NULL;
+    std::size_t len  = 0;
+    std::string name;
+    bool        owner = false;
+
+public:
+    shared_memory() {}
+    ~shared_memory() { close(); }
+
+    shared_memory(shared_memory const&) = delete;
+    shared_memory& operator=(shared_memory const&) = delete;
+
+    /* creates the object with the given size and mode, zero-filled, fails if it exists */
+    bool create(std::string const& object_name, std::size_t size, mode_t mode)
+    {
+        close();
+        fd = shm_open(object_name.c_str(), O_RDWR | O_CREAT | O_EXCL, mode);
+        if (fd < 0) {
+            if (errno != EEXIST) wrn_msg("Could not create shared memory %s: %s", object_name.c_str(), strerror(errno));
+            return false;
+        }
+        name = object_name;
+        owner = true;
+        if (fchmod(fd, mode) != 0 or ftruncate(fd, size) != 0) {
+            wrn_msg("Could not set up shared memory %s: %s", name.c_str(), strerror(errno));
+            close();
+            return false;
+        }
+        if (not map(size, true)) { close(); return false; }
+        std::memset(base, 0, len);
+        return true;
+    }
+
+    /* maps an existing object, which must have at least the given size */
+    bool open(std::string const& object_name, std::size_t size, bool writable)
+    {
+        close();
+        fd = shm_open(object_name.c_str(), writable ? O_RDWR : O_RDONLY, 0);
+        if (fd < 0) { wrn_msg("Could not open shared memory %s: %s", object_name.c_str(), strerror(errno)); return false; }
+        name = object_name;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 or static_cast<std::size_t>(st.st_size) < size) {
+            wrn_msg("Shared memory %s is smaller than expected.", name.c_str());
+            close();
+            return false;
+        }
+        if (not map(size, writable)) { close(); return false; }
+        return true;
+    }
+
+    /* unmaps the object, the creator also removes its name */
+    void close(void)
+    {
+        if (base != NULL) munmap(base, len);
+        if (fd >= 0) ::close(fd);
+        if (owner) shm_unlink(name.c_str());
+        fd = -1;
+        base = NULL;
+        len = 0;
+        owner = false;
+    }
+
+    /* removes a left-over object, e.g. of a crashed process */
+    static bool unlink(std::string const& object_name) { return shm_unlink(object_name.c_str()) == 0; }
+
+    bool is_open(void) const { return base != NULL; }
+
+    uint8_t*    data(void) const { return base; }
+    std::size_t size(void) const { return len; }
+
+private:
+    bool map(std::size_t size, bool writable) {
+        void* p = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) { wrn_msg("Could not map shared memory %s: %s", name.c_str(), strerror(errno)); return false; }
+        base = static_cast<uint8_t*>(p);
+        len = size;
+        lock_region(base, len);
+        return true;
+    }
+};
+
+} /* namespace supreme */
+
+#endif /* SUPREME_SHARED_MEMORY_HPP */
@@ -0,0 +1,54 @@
+/*---------------------------------+
+ | Supreme Machines                |
+ | Sensorimotor C++ Library        |
+ | Matthias Kubisch                |
+ | kubisch@informatik.hu-berlin.de |
+ | November 2018                   |
+ +---------------------------------*/
+
+#ifndef SUPREME_TRIPLE_BUFFER_HPP
+#define SUPREME_TRIPLE_BUFFER_HPP
+
+#include <atomic>
+
+namespace supreme {
+
+/* Lock-free triple buffer for passing snapshots from one writer to one reader.
+
+   The writer fills write_buffer() and publishes it, the reader calls update()
+   and then accesses read_buffer(), which always holds the latest complete
+   snapshot. Neither side ever waits for the other, intermediate snapshots
+   are dropped when the writer is faster than the reader.
+*/
+template <typename T>
+class triple_buffer {
+    static const unsigned index_mask = 0x3;
+    static const unsigned fresh_bit  = 0x4;
+
+    T buffers[3];
+    std::atomic<unsigned> middle; /* exchanged between both sides */
+    unsigned back  = 1;           /* owned by writer */
+    unsigned front = 2;           /* owned by reader */
+
+public:
+    triple_buffer() : buffers(), middle(0) {}
+
+    /* writer side */
+    T& write_buffer(void) { return buffers[back]; }
+
+    void publish(void) { back = middle.exchange(back | fresh_bit, std::memory_order_acq_rel) & index_mask; }
+
+    /* reader side, returns true if a new snapshot was published since the last update */
+    bool update(void) {
+        if (not (middle.load(std::memory_order_relaxed) & fresh_bit)) return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & index_mask;
+        return true;
+    }
+
+    const T& read_buffer(void) const { return buffers[front]; }
+          T& read_buffer(void)       { return buffers[front]; }
+};
+
+} /* namespace supreme */
+
+#endif /* SUPREME_TRIPLE_BUFFER_HPP */
@@ -2,142 +2,202 @@
 #define SUPREME_COMMUNICATION_CTRL_HPP
 
 #include <unistd.h>
+#include <poll.h>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
 #include <mutex>
-#include <queue>
+#include <thread>
+#include <string>
 #include "serial/rs232.h"
-#include "communication_interface.hpp"
+#include "common/realtime.h"
+#include "common/serial_port.h"
+#include "buffered_communication.hpp"
 
 namespace supreme {
 
+/* BaudRate is the default rate, serial_options may select any other */
 template <unsigned BaudRate = 1000000>
-class communication_controller : public communication_interface {
+class communication_controller final : public buffered_communication {
 
-    typedef std::mutex               mutex_t;
-    typedef std::lock_guard<mutex_t> lock_t;
+    /**TODO try checking all ttyUSBx until first device responds */
 
-    const int def_device = 17; /* /dev/ttyUSB1 */
-    const int alt_device = 16; /* /dev/ttyUSB0 */
+    int device = -1; /* of the RS232 lib, if opened by number */
+    int fd     = -1;
+    std::string path;
+    int latency_timer_restore = -1;
 
-    /**TODO try checking all ttyUSBx until first device responds, IDs 16..21 are allowed by RS232 lib*/
-
-    int device = def_device;
-
-    const int baudrate = BaudRate;  /* baud */
+    const unsigned baudrate = BaudRate;  /* baud */
     unsigned char buf[4096];
     const char mode[4] = {'8','N','1',0};
 
     bool connected; //TODO test regularly
-    mutable mutex_t send_mtx;
-    mutable mutex_t recv_mtx;
 
-    std::queue<uint8_t> send_queue;
-    std::queue<uint8_t> recv_queue;
-    uint8_t send_checksum = 0;
-    uint8_t recv_checksum = 0;
+    /* optional read-ahead thread, draining the device into the receive queue */
+    std::thread             rx_thread;
+    std::atomic<bool>       rx_running;
+    mutable std::mutex      rx_mtx;
+    mutable std::condition_variable rx_cv;
+    uint64_t                rx_seen = 0; /* bytes received up to the last read_msg */
+
+    static const int rx_poll_timeout_ms = 20; /* latency of stopping the thread */
 
 public:
-    communication_controller()
-    : connected(0 == RS232_OpenComport(device, baudrate, mode))
-    , send_mtx()
-    , recv_mtx()
-    , send_queue()
-    , recv_queue()
+    /* connects to /dev/ttyUSB1 or else /dev/ttyUSB0 with the default options */
+    communication_controller() : communication_controller(serial_options()) {}
+
+    /* connects to the device given by name or path, see serial_options,
+       without a device given the default devices are tried in turn */
+    explicit communication_controller(serial_options const& options)
+    : baudrate(options.baudrate ? options.baudrate : BaudRate)
+    , connected(false)
+    , rx_thread()
+    , rx_running(false)
     {
-        if (connected)
-            sts_msg("Connected to device: %d", device);
+        const unsigned rate = baudrate;
+        if (not options.device.empty())
+            connected = open_device(serial_device_path(options.device), rate, options);
         else {
-            wrn_msg("Could not connect to default device, trying alternative device...");
-            device = alt_device;
-            connected = (0 == RS232_OpenComport(device, baudrate, mode));
-            if (!connected)
-                err_msg(__FILE__,__LINE__, "Can not connect to device %d\n", device);
+            connected = open_device("/dev/ttyUSB1", rate, options);
+            if (not connected) {
+                wrn_msg("Could not connect to default device, trying alternative device...");
+                connected = open_device("/dev/ttyUSB0", rate, options);
+            }
         }
-        sts_msg("Connected to serial device.");
+        if (!connected)
+            err_msg(__FILE__,__LINE__, "Can not connect to device %s\n", path.c_str());
+        sts_msg("Connected to device %s at %u baud.", path.c_str(), rate);
     }
 
-    bool wait_us(unsigned usec) const { return usleep(usec) == 0; }
-    void sleep_s(unsigned  sec) const { sleep(sec); }
-
-    void read_msg() {
-        lock_t lock(recv_mtx);
-        if (not connected) return;
-
-        int n = RS232_PollComport(device, buf, 4095);
-
-        if (n > 0) // copy to queue
-            for (int i = 0; i < n; ++i)
-                recv_queue.push(buf[i]);
+    /* connects to the given device number of the RS232 lib, see comports in serial/rs232.c */
+    explicit communication_controller(int device)
+    : device(device)
+    , connected(0 == RS232_OpenComport(device, baudrate, mode))
+    , rx_thread()
+    , rx_running(false)
+    {
+        if (!connected)
+            err_msg(__FILE__,__LINE__, "Can not connect to device %d\n", device);
+        fd = RS232_GetFileDescriptor(device);
+        sts_msg("Connected to device: %d", device);
     }
 
-    void enqueue_sync_bytes(uint8_t sync) {
-        lock_t lock(send_mtx);
-        send_queue.push(sync);
-        send_queue.push(sync);
-        send_checksum += sync+sync;
+    ~communication_controller() {
+        stop_rx_thread();
+        if (not connected) return;
+        if (device >= 0) RS232_CloseComport(device);
+        else close_serial_port(fd, path, latency_timer_restore);
     }
 
-    void enqueue_byte(uint8_t byte) {
-        lock_t lock(send_mtx);
-        send_queue.push(byte);
-        send_checksum += byte;
+    std::string const& get_device(void) const { return path; }
+
+    /* Starts the read-ahead thread, which blocks on the device and copies the bytes
+       into the receive queue as soon as they arrive, timestamping each chunk. Then
+       read_msg makes no system call, waiting for data waits for the thread and the
+       response times refer to the arrival instead of the time the bytes were parsed.
+       A priority > 0 selects SCHED_FIFO, a cpu >= 0 pins the thread to that cpu. */
+    bool start_rx_thread(int priority = 0, int cpu = -1) {
+        if (not connected or rx_running) return false;
+        rx_seen = rx_total.load(std::memory_order_acquire);
+        rx_running = true;
+        rx_thread = std::thread(&communication_controller::receive_loop, this);
+        if (priority > 0) set_realtime_priority(rx_thread, priority);
+        if (cpu >= 0) set_cpu_affinity(rx_thread, cpu);
+        sts_msg("Receive thread started.");
+        return true;
     }
 
-    void enqueue_word(uint16_t word) {
-        enqueue_byte( (uint8_t) (word >> 8) ); // high byte
-        enqueue_byte( (uint8_t) (0x00ff & word) ); //  low byte
+    void stop_rx_thread(void) {
+        if (not rx_running) return;
+        rx_running = false;
+        rx_thread.join();
+        sts_msg("Receive thread stopped.");
     }
 
-    void enqueue_checksum(void) {
-        lock_t lock(send_mtx);
-        send_queue.push(~send_checksum + 1);
-        send_checksum = 0;
-    }
+    bool has_rx_thread(void) const { return rx_running; }
 
-    bool       empty() const { lock_t lock(recv_mtx); return recv_queue.empty(); }
-    void         pop()       { lock_t lock(recv_mtx); recv_queue.pop();          }
-    uint8_t    front() const { lock_t lock(recv_mtx); return recv_queue.front(); }
-    std::size_t size() const { lock_t lock(recv_mtx); return recv_queue.size();  }
-
-    uint8_t get_byte() {
-        lock_t lock(recv_mtx);
-        assert(recv_queue.size() > 0);
-        uint8_t tmp = recv_queue.front();
-        recv_queue.pop();
-        recv_checksum += tmp;
-        return tmp;
-    }
+    bool wait_us(unsigned usec) const { return usleep(usec) == 0; }
+    unsigned get_baudrate(void) const { return baudrate; }
+    void sleep_s(unsigned  sec) const { sleep(sec); }
 
-    uint16_t get_word() {
-        lock_t lock(recv_mtx);
-        assert(recv_queue.size() > 1);
-        uint8_t tmp1 = recv_queue.front(); recv_queue.pop();
-        uint8_t tmp0 = recv_queue.front(); recv_queue.pop();
-        recv_checksum += tmp1;
-        recv_checksum += tmp0;
-        return (tmp1 << 8) + tmp0;
+    bool wait_for_data(clock_t::time_point deadline) const {
+        if (not connected) { std::this_thread::sleep_until(deadline); return false; }
+        const auto now = clock_t::now();
+        if (rx_running) {
+            std::unique_lock<std::mutex> lock(rx_mtx);
+            const bool ready = rx_cv.wait_until(lock, deadline, [this]() { return rx_total.load(std::memory_order_acquire) > rx_seen; });
+            timing.wait_ns += elapsed_ns(now);
+            return ready;
+        }
+        if (now >= deadline) return false;
+
+        const long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now).count();
+        const struct timespec timeout = { static_cast<time_t>(ns / 1000000000), static_cast<long>(ns % 1000000000) };
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        const int res = ppoll(&pfd, 1, &timeout, NULL);
+        timing.wait_ns += elapsed_ns(now);
+        return res > 0 or (res < 0 and errno == EINTR); /* on signal, let the caller check and wait again */
     }
 
-    bool is_checksum_ok() const { return (recv_checksum == 0); }
-    void reset_checksum() { recv_checksum = 0; }
+    void read_msg() {
+        if (not connected) return;
+        if (rx_running) { rx_seen = rx_total.load(std::memory_order_acquire); return; } /* already in the queue */
 
+        const auto t0 = clock_t::now();
+        const ssize_t n = read(fd, buf, std::min(sizeof(buf), recv_queue.space()));
+        timing.read_ns += elapsed_ns(t0);
 
+        if (n > 0) { // copy to queue
+            recv_queue.write(buf, n);
+            note_arrival(n, clock_t::now());
+            if (capture) capture->append(bus_capture::received, buf, n);
+        }
+    }
 
     /**
         returns true if buffer was sent successfully
     */
     bool send_msg() {
-        lock_t lock(send_mtx);
-        if (not connected) return 0;
-        std::size_t ptr = 0;
-        while(not send_queue.empty()) {
-            buf[ptr++] = send_queue.front();
-            send_queue.pop();
-            if (ptr >= sizeof(buf) - 1 )
-                err_msg(__FILE__,__LINE__,"Buffer overflow.");
-        }
+        if (not connected) { send_queue.clear(); return 0; }
         assert(send_checksum == 0);
-        /* send buffer all at once */
-        return ((int)ptr == RS232_SendBuf(device, buf, ptr));
+        /* send buffer all at once, directly from the contiguous queue storage */
+        const std::size_t len = send_queue.size();
+        const auto t0 = clock_t::now();
+        const ssize_t n = write(fd, send_queue.peek(), len);
+        timing.send_ns += elapsed_ns(t0);
+        if (capture) capture->append(bus_capture::sent, send_queue.peek(), len);
+        send_queue.clear();
+        return (static_cast<ssize_t>(len) == n);
+    }
+
+private:
+
+    bool open_device(std::string const& name, unsigned rate, serial_options const& options) {
+        path = name;
+        fd = open_serial_port(path, rate, options, latency_timer_restore);
+        return fd >= 0;
+    }
+
+    void receive_loop(void) {
+        lock_thread_stack();
+        unsigned char chunk[queue_size];
+        while (rx_running) {
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            if (poll(&pfd, 1, rx_poll_timeout_ms) <= 0) continue;
+            const auto t = clock_t::now();
+            const std::size_t space = recv_queue.space();
+            if (space == 0) { std::this_thread::yield(); continue; } /* parser is behind */
+
+            const ssize_t n = read(fd, chunk, space);
+            if (n <= 0) continue;
+            recv_queue.write(chunk, n);
+            {
+                std::lock_guard<std::mutex> lock(rx_mtx);
+                note_arrival(n, t);
+            }
+            rx_cv.notify_one();
+            if (capture) capture->append(bus_capture::received, chunk, n);
+        }
     }
 };
 
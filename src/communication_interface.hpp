@@ -2,10 +2,30 @@
 #define SUPREME_COMMUNICATION_INTERFACE_HPP
 
 #include <cstdint>
+#include <cstddef>
+#include <chrono>
+
+/* contiguous read-only view on received bytes */
+struct byte_span {
+    const uint8_t* data;
+    std::size_t    size;
+
+    uint8_t  operator[](std::size_t i) const { return data[i]; }
+    uint16_t word(std::size_t i) const { return (data[i] << 8) + data[i+1]; } /* high byte first */
+};
+
+/* accumulated time spent in the transport's system calls */
+struct io_timing {
+    uint64_t send_ns = 0;
+    uint64_t wait_ns = 0;
+    uint64_t read_ns = 0;
+};
 
 class communication_interface {
 public:
 
+    typedef std::chrono::steady_clock clock_t;
+
     virtual ~communication_interface() {};
 
     virtual void read_msg(void) = 0;
@@ -13,10 +33,18 @@ public:
     virtual bool wait_us(unsigned usec) const = 0;
     virtual void sleep_s(unsigned  sec) const = 0;
 
+    /* blocks until new bytes can be read or the deadline has passed,
+       returns false on timeout */
+    virtual bool wait_for_data(clock_t::time_point deadline) const = 0;
+
+    /* of the wire, to estimate the transfer times of the bytes, 0 if unknown or instant */
+    virtual unsigned get_baudrate(void) const = 0;
+
 
     virtual void enqueue_sync_bytes(uint8_t sync) = 0;
     virtual void enqueue_byte(uint8_t byte) = 0;
     virtual void enqueue_word(uint16_t word) = 0;
+    virtual void enqueue_bytes(const uint8_t* bytes, std::size_t len) = 0;
     virtual void enqueue_checksum() = 0;
 
     /* queue-like interface */
@@ -25,6 +53,16 @@ public:
     virtual void pop(void) = 0;
     virtual std::size_t size() const = 0;
 
+    /* span-like interface, a view stays valid until the bytes are consumed */
+    virtual byte_span peek(std::size_t len) const = 0; /* contiguous view on the first min(len, size()) bytes */
+    virtual void consume(std::size_t len) = 0;          /* removes bytes and adds them to the checksum */
+
+    /* point in time the byte at 'offset' from the read position was received by the
+       transport, i.e. read from the device, or now if unknown */
+    virtual clock_t::time_point arrival_time(std::size_t offset) const = 0;
+
+    virtual io_timing const& get_io_timing(void) const = 0;
+
     virtual bool is_checksum_ok(void) const = 0;
     virtual void reset_checksum(void) = 0;
 
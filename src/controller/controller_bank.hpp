@@ -0,0 +1,141 @@
+#ifndef SUPREME_CONTROLLER_BANK_HPP
+#define SUPREME_CONTROLLER_BANK_HPP
+
+#include <vector>
+#include "../common/modules.h"
+#include "pid_control.hpp"
+#include "csl_control.hpp"
+#include "impulse_ctrl.hpp"
+
+namespace supreme {
+
+/* Steps the controllers of many motors in one pass.
+
+   Gains, integrator and CSL states are stored as contiguous arrays (one
+   entry per motor), the CSL gains gi and gf are computed when a motor's
+   parameters are loaded rather than on every step. The kernel has the same
+   semantics as sensorimotor::execute_controller, i.e. the controllers not
+   selected are reset, and can also be used standalone, e.g. for offline
+   rollouts without a motorcord.
+*/
+class controller_bank {
+public:
+    /* controller types, same numbering as sensorimotor::Controller_t */
+    enum type_t { none = 0, voltage = 1, position = 2, csl = 3, impulse = 4 };
+
+    controller_bank(std::size_t number_of_motors = 0) { resize(number_of_motors); }
+
+    void resize(std::size_t N) {
+        type      .assign(N, none);
+        enabled   .assign(N, 1);
+        disabled  .assign(N, 0);
+        lim_lo    .assign(N, -0.90);
+        lim_hi    .assign(N, +0.90);
+        target    .assign(N, .0);
+        Kp        .assign(N, 0.8);
+        Ki        .assign(N, .0);
+        err_int   .assign(N, .0);
+        z         .assign(N, .0);
+        gi        .assign(N, .0);
+        gf        .assign(N, .0);
+        csl_lo    .assign(N, -0.8);
+        csl_hi    .assign(N, +0.8);
+        imp_value .assign(N, .0);
+        imp_steps .assign(N, 0);
+        output    .assign(N, .0);
+    }
+
+    std::size_t size(void) const { return type.size(); }
+
+    /* loads the parameters of motor i, controller states are kept */
+    void load(std::size_t i, int controller, pid_control const& pid, csl_control const& cslc, double disable_lo, double disable_hi) {
+        type  [i] = controller;
+        lim_lo[i] = disable_lo;
+        lim_hi[i] = disable_hi;
+        target[i] = pid.target_value;
+        Kp    [i] = pid.Kp;
+        Ki    [i] = pid.Ki;
+        gi    [i] = csl_control::csl_gi(cslc.target_csl_mode);
+        gf    [i] = csl_control::csl_gf(cslc.target_csl_mode, cslc.target_csl_fb);
+        csl_lo[i] = cslc.limit_lo;
+        csl_hi[i] = cslc.limit_hi;
+    }
+
+    void load_impulse(std::size_t i, impulse_control const& imp) {
+        imp_value[i] = imp.value;
+        imp_steps[i] = imp.duration;
+    }
+
+    /* entries not enabled, e.g. motors not responding, keep their states and output zero */
+    void set_enabled(std::size_t i, bool enable) { enabled[i] = enable; }
+
+    /* steps all controllers given the current positions p[0..size()),
+       the resulting voltages can be read via get_output(),
+       written with selects instead of branches to allow vectorization */
+    void step(const double* p)
+    {
+        const std::size_t N = size();
+        for (std::size_t i = 0; i < N; ++i)
+        {
+            const bool en = enabled[i];
+            const bool out_of_range = (p[i] < lim_lo[i]) or (p[i] > lim_hi[i]);
+            disabled[i] = en and out_of_range and (type[i] != none);
+            const int t = (en and out_of_range) ? static_cast<int>(none) : type[i];
+            type[i] = t;
+
+            const double gp = gi[i] * p[i];
+
+            /* position */
+            const double err  = target[i] - p[i];
+            const double eint = (t == position) ? clip1(err_int[i] + err, 1.0) : .0;
+            const double u_pos = Kp[i]*err + Ki[i]*eint;
+            err_int[i] = en ? eint : err_int[i];
+
+            /* csl */
+            double zc = z[i];
+            zc = (p[i] > csl_hi[i]) ? std::min(zc, gp) : zc;
+            zc = (p[i] < csl_lo[i]) ? std::max(zc, gp) : zc;
+            const double u_csl = clip1(-gp + zc, .5);
+            const double z_new = (t == csl) ? gp + gf[i] * u_csl : gp;
+            z[i] = en ? z_new : z[i];
+
+            /* impulse */
+            const bool imp_active = (t == impulse) and (imp_steps[i] > 0);
+            const double u_imp = imp_active ? imp_value[i] : .0;
+            imp_steps[i] = (not en) ? imp_steps[i] : imp_active ? imp_steps[i] - 1 : (t == impulse) ? imp_steps[i] : 0;
+            imp_value[i] = (en and t != impulse) ? .0 : imp_value[i];
+
+            output[i] = (not en       ) ? .0
+                      : (t == position) ? u_pos
+                      : (t == csl     ) ? u_csl
+                      : (t == impulse ) ? u_imp
+                      : .0;
+        }
+    }
+
+    /* true if the controller of motor i drives the output voltage */
+    bool is_driving(std::size_t i) const { return type[i] == position or type[i] == csl or type[i] == impulse; }
+
+    /* true if motor i was disabled in the last step because its position exceeded the limits */
+    bool was_disabled(std::size_t i) const { return disabled[i] != 0; }
+
+    double get_output(std::size_t i) const { return output[i]; }
+    const double* get_outputs(void) const { return output.data(); }
+
+private:
+    static double clip1(double x, double limit) { return std::max(-limit, std::min(limit, x)); }
+
+    std::vector<int>      type;
+    std::vector<int>      enabled;
+    std::vector<int>      disabled;
+    std::vector<double>   lim_lo, lim_hi;
+    std::vector<double>   target, Kp, Ki, err_int;        /* position */
+    std::vector<double>   z, gi, gf, csl_lo, csl_hi;      /* csl */
+    std::vector<double>   imp_value;                      /* impulse */
+    std::vector<unsigned> imp_steps;
+    std::vector<double>   output;
+};
+
+} /* namespace supreme */
+
+#endif /* SUPREME_CONTROLLER_BANK_HPP */
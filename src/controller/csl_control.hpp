@@ -29,11 +29,16 @@ public:
 
     /* TODO make value gi configurable */
     void update_mode() {
-        const double mode = clip(target_csl_mode);
-        gi = posneg(mode, 4.0, 16.0); /** TODO on gi change, reset z to correct value */
-        gf = target_csl_fb * pos(mode);
+        if (target_csl_mode == applied_mode and target_csl_fb == applied_fb) return; /* gains are up to date */
+        gi = csl_gi(target_csl_mode); /** TODO on gi change, reset z to correct value */
+        gf = csl_gf(target_csl_mode, target_csl_fb);
+        applied_mode = target_csl_mode;
+        applied_fb   = target_csl_fb;
     }
 
+    static double csl_gi(double mode) { return posneg(clip(mode), 4.0, 16.0); }
+    static double csl_gf(double mode, double fb) { return fb * pos(clip(mode)); }
+
     double step(double /*current position=*/p)
     {
         update_mode();
@@ -51,6 +56,11 @@ public:
         update_mode();
         z = gi * p; /* set initial conditions */
     }
+
+private:
+    /* mode and feedback the gains were computed for, initially such that gi and gf are computed on first use */
+    double applied_mode = .0;
+    double applied_fb   = .0;
 };
 
 } /* namespace supreme */
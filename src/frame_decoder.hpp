@@ -0,0 +1,83 @@
+#ifndef SUPREME_FRAME_DECODER_HPP
+#define SUPREME_FRAME_DECODER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include "communication_interface.hpp"
+
+namespace supreme {
+
+/* returns the number of bytes of a response following the sync bytes,
+   including command byte, id and checksum, or zero if the command is unknown */
+constexpr uint8_t response_length(std::size_t cmd) {
+    return (cmd == 0x80) ? 13  /* cmd + id + 2pos + 2cur + 2uba + 2usu +2tmp + chk */
+         : (cmd == 0xE1) ?  3  /* cmd + id + chk */
+         : (cmd == 0x41) ?  9  /* cmd + id + x(2), y(2), z(2) + chk */
+         : 0;
+}
+
+namespace detail {
+    template <std::size_t... I> struct index_list {};
+    template <std::size_t N, std::size_t... I> struct make_index_list : make_index_list<N - 1, N - 1, I...> {};
+    template <std::size_t... I> struct make_index_list<0, I...> { typedef index_list<I...> type; };
+
+    template <typename> struct length_table;
+    template <std::size_t... I> struct length_table<index_list<I...>> {
+        static constexpr uint8_t value[sizeof...(I)] = { response_length(I)... };
+    };
+    template <std::size_t... I> constexpr uint8_t length_table<index_list<I...>>::value[sizeof...(I)];
+}
+
+/* Decodes all complete response frames of a received buffer in one pass.
+
+   The buffer is scanned for pairs of sync bytes (0xFF 0xFF), the length of
+   the frame is looked up by its command byte in a table built at compile
+   time and the checksum is verified over the whole frame. Bytes not
+   belonging to a frame are skipped, an incomplete frame at the end of the
+   buffer is left for the next scan, after more bytes were received.
+*/
+struct frame_decoder {
+
+    typedef detail::length_table<detail::make_index_list<256>::type> table;
+
+    static std::size_t length(uint8_t cmd) { return table::value[cmd]; }
+
+    /* true if all bytes of the frame including the sync bytes sum up to zero */
+    static bool is_checksum_ok(byte_span frame) {
+        uint8_t sum = 0xFE; /* both sync bytes */
+        for (std::size_t i = 0; i < frame.size; ++i) sum += frame[i];
+        return sum == 0;
+    }
+
+    /* calls on_frame(byte_span frame, bool checksum_ok) for each complete frame,
+       the frame starts with the command byte, and on_unknown() for each unknown
+       command byte after a sync. Returns the number of bytes processed, i.e.
+       all bytes to be consumed from the receive queue. */
+    template <typename FrameHandler, typename UnknownHandler>
+    static std::size_t scan(byte_span buf, FrameHandler on_frame, UnknownHandler on_unknown)
+    {
+        std::size_t i = 0;
+        while (i < buf.size) {
+            if (buf[i] != 0xFF) { ++i; continue; }         /* unexpected first sync byte */
+            if (i + 1 == buf.size) break;
+            if (buf[i+1] != 0xFF) { i += 2; continue; }    /* unexpected second sync byte */
+            if (i + 2 == buf.size) break;
+
+            const uint8_t cmd = buf[i+2];
+            if (cmd == 0xFF) { ++i; continue; }            /* more than two sync bytes */
+
+            const std::size_t len = length(cmd);
+            if (len == 0) { on_unknown(); i += 2; continue; }
+            if (i + 2 + len > buf.size) break;
+
+            const byte_span frame = { buf.data + i + 2, len };
+            on_frame(frame, is_checksum_ok(frame));
+            i += 2 + len;
+        }
+        return i;
+    }
+};
+
+} /* namespace supreme */
+
+#endif /* SUPREME_FRAME_DECODER_HPP */
@@ -1,26 +1,66 @@
 #ifndef SUPREME_INTERFACE_DATA_HPP
 #define SUPREME_INTERFACE_DATA_HPP
 
+#include <cstdint>
+#include <algorithm>
+
 namespace supreme {
 
     struct Statistics_t {
+        static const unsigned histogram_size = 16;
+
         unsigned errors = 0;
         unsigned timeouts = 0;
+        unsigned checksum_errors = 0;  /* responses of this motor with wrong checksum */
+        unsigned unknown_commands = 0; /* unknown command bytes while waiting for this motor */
         unsigned response_time_us = 0;
         float    avg_resp_time_us = 0.0;
         unsigned max_resp_time_us = 0;
+        unsigned timeout_us = 0; /* timeout currently applied */
+
+        /* response times (without timeouts), bucket b > 0 counts [2^b, 2^(b+1)) us, the last one all above */
+        unsigned histogram[histogram_size] = {};
 
         bool faulted = false;
 
+        unsigned health = 0;      /* see sensorimotor::health_t */
+        unsigned send_errors = 0; /* commands which could not be written */
+        unsigned quarantines = 0; /* times the motor was quarantined */
+        unsigned skipped = 0;     /* cycles without transaction, see suppression_settings */
+
         void update(unsigned time_us, bool timeout, bool invalid) {
             if (invalid) ++errors;
             if (timeout) ++timeouts;
+            else ++histogram[bucket(time_us)];
             faulted = timeout or invalid;
             response_time_us = time_us;
             avg_resp_time_us = 0.99*avg_resp_time_us + 0.01*time_us;
             max_resp_time_us = std::max(max_resp_time_us, time_us);
         }
 
+        static unsigned bucket(unsigned time_us) {
+            unsigned b = 0;
+            while (time_us >>= 1) ++b;
+            return std::min(b, histogram_size - 1);
+        }
+
+    };
+
+    /* durations of the phases of a bus cycle */
+    struct cycle_timing {
+        uint64_t cycle            = 0;
+        unsigned send_us          = 0; /* writing to the serial device */
+        unsigned wait_us          = 0; /* waiting for bytes to arrive */
+        unsigned read_us          = 0; /* reading from the serial device */
+        unsigned parse_us         = 0; /* remaining time of the transactions, i.e. encoding and parsing */
+        unsigned controller_us    = 0;
+        unsigned total_us         = 0; /* transactions and controllers */
+        unsigned slack_us         = 0; /* idle time until the next cycle, refers to the previous cycle */
+        unsigned unknown_commands = 0; /* unknown command bytes in pipelined mode, accumulated */
+        unsigned lateness_us      = 0; /* wake-up after the deadline of the cycle, paced only */
+        unsigned overruns         = 0; /* cycles ending after their deadline, accumulated */
+        unsigned skipped          = 0; /* deadlines dropped after overruns, accumulated */
+        unsigned send_errors      = 0; /* writes to the bus which failed, accumulated */
     };
 
     struct interface_data {
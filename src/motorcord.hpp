@@ -1,36 +1,124 @@
 #ifndef SUPREME_MOTORCORD_HPP
 #define SUPREME_MOTORCORD_HPP
 
+#include <memory>
+#include <cstring>
+#include <limits>
 #include "sensorimotor.hpp"
 #include "communication_ctrl.hpp"
+#include "telemetry_recorder.hpp"
+#include "common/allocation_guard.h"
 
 namespace supreme {
 
-class motorcord {
+/* All motors on one bus, templated on the transport type like basic_sensorimotor */
+template <typename Transport = communication_interface>
+class basic_motorcord {
+public:
+    static const uint8_t max_boards = 128;
+
+    typedef basic_sensorimotor<Transport> motor_t;
 
-    const uint8_t max_boards = 128;
+private:
+    typedef communication_interface::clock_t clock_t;
 
     std::size_t cyclecounter = 0;
+    cycle_timing timing;
 
-    communication_controller<1000000>  com;
+    /* the serial transport, unless another transport was given */
+    std::unique_ptr<Transport> own_com;
+    Transport&                 com;
 
-    std::vector<sensorimotor> motors;
+    std::vector<motor_t> motors;
 
     bool rescan_for_motors = true;
     std::size_t num_active_motors = 0;
 
     bool verbose;
 
+    /* pipelined mode: max. number of commands sent before their responses
+       have arrived, a depth of 1 resembles the sequential bus transactions */
+    std::size_t pipeline_depth = 1;
+
+    /* bulk mode: commands of all active motors are sent with a single write */
+    bool bulk_commands = false;
+
+    /* discovery: pings all ids in one burst instead of one after another */
+    bool fast_discovery = false;
+
+    /* number of inactive ids pinged per cycle, zero disables the
+       incremental re-probing, re-probing continues at 'next_probe_id' */
+    std::size_t reprobe_per_cycle = 0;
+    std::size_t next_probe_id = 0;
+
+    /* steps the controllers of all motors in one pass instead of per motor */
+    bool use_controller_bank = false;
+    controller_bank bank;
+    std::vector<double> positions;
+
+    /* external sensors: polled every 'divisor' cycles, at most 'per_cycle' motors
+       of a polling cycle in round-robin order, starting at 'next_sensor_id' (0: all) */
+    std::size_t sensor_divisor   = 1;
+    std::size_t sensor_per_cycle = 0;
+    std::size_t next_sensor_id   = 0;
+    std::vector<uint8_t> poll_sensor; /* motors polled in this cycle */
+
+    /* motors with a transaction in this cycle, see suppression_settings */
+    std::vector<uint8_t> transact;
+
+    /* rate groups: motor i is serviced in the cycles c with c % rate_divisor[i] == rate_phase[i],
+       the phases are assigned by update_rate_schedule before the next cycle if changed */
+    std::vector<std::size_t> rate_divisor;
+    std::vector<std::size_t> rate_phase;
+    std::vector<uint8_t>     rate_due; /* motors serviced in this cycle */
+    bool rate_schedule_changed = false;
+    static const std::size_t max_hyperperiod = 10000; /* cycles balanced by the schedule */
+
+    /* converts the calibrated sensors only when requested, see decode_sensors */
+    bool deferred_decoding = false;
+
+    /* appends the state of all motors after each cycle, if set */
+    telemetry_recorder* recorder = NULL;
+
 public:
-    motorcord(uint8_t number_of_boards, bool verbose = true)
-    : com(), motors(), verbose(verbose)
+    basic_motorcord(uint8_t number_of_boards, bool verbose = true)
+    : basic_motorcord(number_of_boards, verbose, new communication_controller<1000000>())
+    {}
+
+    /* uses the given serial device number instead of the default devices */
+    basic_motorcord(uint8_t number_of_boards, bool verbose, int device)
+    : basic_motorcord(number_of_boards, verbose, new communication_controller<1000000>(device))
+    {}
+
+    /* opens the serial device with the given options, e.g. by name and at a custom baud rate */
+    basic_motorcord(uint8_t number_of_boards, bool verbose, serial_options const& options)
+    : basic_motorcord(number_of_boards, verbose, new communication_controller<1000000>(options))
+    {}
+
+    /* uses the given transport, e.g. a simulated bus, which must outlive the motorcord */
+    basic_motorcord(uint8_t number_of_boards, bool verbose, Transport& transport)
+    : own_com(), com(transport), motors(), verbose(verbose), bank(number_of_boards), positions(number_of_boards, .0)
+    , poll_sensor(number_of_boards, 0), transact(number_of_boards, 0)
+    , rate_divisor(number_of_boards, 1), rate_phase(number_of_boards, 0), rate_due(number_of_boards, 0)
     {
         assert(number_of_boards <= max_boards);
         for (uint8_t id = 0; id < number_of_boards; ++id)
             motors.emplace_back(id, com);
     }
 
-    ~motorcord() {
+private:
+    basic_motorcord(uint8_t number_of_boards, bool verbose, Transport* owned)
+    : own_com(owned), com(*owned), motors(), verbose(verbose), bank(number_of_boards), positions(number_of_boards, .0)
+    , poll_sensor(number_of_boards, 0), transact(number_of_boards, 0)
+    , rate_divisor(number_of_boards, 1), rate_phase(number_of_boards, 0), rate_due(number_of_boards, 0)
+    {
+        assert(number_of_boards <= max_boards);
+        for (uint8_t id = 0; id < number_of_boards; ++id)
+            motors.emplace_back(id, com);
+    }
+
+public:
+    ~basic_motorcord() {
         sts_msg("Disabling motors");
         disable_all();
         execute_cycle();
@@ -39,68 +127,472 @@ public:
 
     void disable_all(void) { for (auto &m : motors) m.disable(); }
 
-          sensorimotor& operator[] (std::size_t index)       { return motors.at(index); }
-    const sensorimotor& operator[] (std::size_t index) const { return motors.at(index); }
+          motor_t& operator[] (std::size_t index)       { return motors.at(index); }
+    const motor_t& operator[] (std::size_t index) const { return motors.at(index); }
 
     std::size_t size() const { return motors.size(); }
 
+    /* sets the max. number of outstanding commands, using a depth greater than 1
+       requires the bus to tolerate the next command while a response is still arriving */
+    void set_pipeline_depth(std::size_t depth) { pipeline_depth = std::max<std::size_t>(1, depth); }
+    std::size_t get_pipeline_depth(void) const { return pipeline_depth; }
+
+    /* packs the commands of all active motors into one buffer, flushed by one write per cycle */
+    void set_bulk_commands(bool enable) { bulk_commands = enable; }
+    bool get_bulk_commands(void) const { return bulk_commands; }
+
+    /* selects stepping all controllers in one pass of the controller bank,
+       controller states restart from zero when switching */
+    void set_controller_bank(bool enable) {
+        use_controller_bank = enable;
+        if (enable) for (auto& m : motors) m.set_controller_type(m.get_controller_type()); /* reload all parameters */
+    }
+
+    /* polls the external sensors of the motors reading them (see set_ext_sensor_readout)
+       only every 'divisor' cycles and, if per_cycle > 0, only 'per_cycle' of them per
+       polling cycle in turn. In pipelined and bulk mode the sensor request is sent
+       with the motor command, otherwise it is a separate transaction. */
+    void set_external_sensor_schedule(std::size_t divisor, std::size_t per_cycle) {
+        sensor_divisor = std::max<std::size_t>(1, divisor);
+        sensor_per_cycle = per_cycle;
+    }
+
+    /* services motor i only every 'divisor' cycles, e.g. 10 for 100 Hz at a 1 kHz
+       cycle. The motors of the slower groups are spread over the cycles by a static
+       schedule, such that the number of transactions per cycle is about the same in
+       every cycle. Harmonic divisors (e.g. 1, 2, 4, 10, 20) balance best. Skipped
+       cycles do not count, neither for the controller of a motor nor for the
+       keep-alive of the command suppression, i.e. both run at the motor's rate. */
+    void set_rate_divisor(std::size_t i, std::size_t divisor) {
+        rate_divisor.at(i) = std::max<std::size_t>(1, divisor);
+        rate_schedule_changed = true;
+    }
+    std::size_t get_rate_divisor(std::size_t i) const { return rate_divisor.at(i); }
+
+    /* the cycles modulo the divisor in which motor i is serviced */
+    std::size_t get_rate_phase(std::size_t i) const { return rate_phase.at(i); }
+
+    /* stores the sensor words only, to be converted in one pass by decode_sensors,
+       position and velocity are always decoded on receipt for the controllers */
+    void set_deferred_decoding(bool enable) {
+        deferred_decoding = enable;
+        for (auto& m : motors) m.set_deferred_decoding(enable);
+    }
+    bool get_deferred_decoding(void) const { return deferred_decoding; }
+
+    /* converts the sensor words of all motors */
+    void decode_sensors(void) { for (auto& m : motors) m.decode_sensors(); }
+
+    /* pings all ids in one burst and collects the replies as they arrive, requires
+       the bus to tolerate pings while replies are arriving, as the pipelined mode */
+    void set_fast_discovery(bool enable) { fast_discovery = enable; }
+
+    /* pings up to n inactive ids per cycle, so motors connected later are found
+       without rescanning all ids, this also replaces the 1s pause and full
+       rescan when no motor is active */
+    void set_reprobe_per_cycle(std::size_t n) { reprobe_per_cycle = n; }
+    std::size_t get_reprobe_per_cycle(void) const { return reprobe_per_cycle; }
+
+    /* motors found by the last scan or re-probing */
+    std::size_t get_number_of_active_motors(void) const { return num_active_motors; }
+
+    /* true if the next cycle starts with a scan of all ids, see rescan */
+    bool is_scan_pending(void) const { return rescan_for_motors; }
+
+    void set_timeout_settings(timeout_settings const& s) { for (auto& m : motors) m.set_timeout_settings(s); }
+
+    /* configures when failing motors are quarantined, see health_settings */
+    void set_health_settings(health_settings const& s) { for (auto& m : motors) m.set_health_settings(s); }
+
+    /* skips the idle motors whose command is unchanged, see suppression_settings */
+    void set_suppression_settings(suppression_settings const& s) { for (auto& m : motors) m.set_suppression_settings(s); }
+
+    /* sets the recorder (not owned, may be NULL), which must be open */
+    void set_recorder(telemetry_recorder* r) { recorder = r; }
+
+          Transport& get_transport(void)       { return com; }
+    const Transport& get_transport(void) const { return com; }
+
     void reset_statistics(void) { for (auto& m : motors) m.reset_statistics(); }
     void rescan(void) { reset_statistics(); rescan_for_motors = true; }
 
 
-    void execute_cycle()
+    /* returns the phase durations of the last cycle */
+    cycle_timing const& get_timing(void) const { return timing; }
+
+    /* returns false if writing to the bus failed during the cycle */
+    bool execute_cycle()
     {
-        if (rescan_for_motors) scan_for_motors();
+        const unsigned send_errors = timing.send_errors;
+        const auto t_start = clock_t::now();
+        const io_timing io_start = com.get_io_timing();
 
-        if (num_active_motors == 0) {
+        if (rescan_for_motors) { scan_for_motors(); rate_schedule_changed = true; }
+        if (rate_schedule_changed) update_rate_schedule();
+
+        if (num_active_motors == 0 and reprobe_per_cycle == 0) {
             com.sleep_s(1);
             rescan_for_motors = true;
         }
 
-        if (verbose)
-            printf("%02lu | ", cyclecounter % 100);
+        /* the cycle proper must not allocate, scans are excluded */
+        allocation_guard guard;
 
-        ++cyclecounter;
+        const uint64_t cycle = cyclecounter++;
+        schedule_rate_groups(cycle);
+        schedule_external_sensors();
+        schedule_transactions();
 
-        unsigned errors = 0;
-        unsigned timeouts = 0;
-        for (auto& m : motors) if (m.is_active()) {
-            auto const& stats = m.execute_cycle();
-            errors += stats.errors;
-            timeouts += stats.timeouts;
-
-            if (verbose) {
-                if (!stats.faulted)
-                    printf("%u:%02u ", m.get_id(), stats.response_time_us);
-                else
-                    printf("%u:_%u ", m.get_id(), m.get_syncstate());
+        if (bulk_commands)
+            execute_transactions_pipelined(motors.size());
+        else if (pipeline_depth > 1)
+            execute_transactions_pipelined(pipeline_depth);
+        else
+            for (std::size_t i = 0; i < motors.size(); ++i) if (transact[i])
+                if (not motors[i].execute_cycle(poll_sensor[i]))
+                    ++timing.send_errors;
+
+        probe_quarantined();
+
+        if (verbose) log_verbose(cycle);
+
+        if (reprobe_per_cycle > 0)
+            reprobe_inactive();
+
+        const auto t_transactions = clock_t::now();
+
+        if (use_controller_bank)
+            execute_controller_bank();
+        else
+            for (std::size_t i = 0; i < motors.size(); ++i) if (rate_due[i] and motors[i].is_active())
+                motors[i].execute_controller();
+
+        update_timing(t_start, t_transactions, io_start);
+
+        if (recorder) {
+            if (deferred_decoding) decode_sensors();
+            recorder->record(cyclecounter, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                               clock_t::now().time_since_epoch()).count(), *this);
+        }
+        return timing.send_errors == send_errors;
+    }
+
+    void update_timing(clock_t::time_point t_start, clock_t::time_point t_transactions, io_timing const& io_start)
+    {
+        const auto t_end = clock_t::now();
+        io_timing const& io = com.get_io_timing();
+        timing.cycle         = cyclecounter;
+        timing.send_us       = (io.send_ns - io_start.send_ns) / 1000;
+        timing.wait_us       = (io.wait_ns - io_start.wait_ns) / 1000;
+        timing.read_us       = (io.read_ns - io_start.read_ns) / 1000;
+        const unsigned transactions_us = motor_t::elapsed_us(t_start, t_transactions);
+        const unsigned io_us = timing.send_us + timing.wait_us + timing.read_us;
+        timing.parse_us      = (transactions_us > io_us) ? transactions_us - io_us : 0;
+        timing.controller_us = motor_t::elapsed_us(t_transactions, t_end);
+        timing.total_us      = motor_t::elapsed_us(t_start, t_end);
+    }
+
+    void execute_controller_bank(void)
+    {
+        for (std::size_t i = 0; i < motors.size(); ++i) {
+            motors[i].load_controller(bank, i);
+            bank.set_enabled(i, rate_due[i] and motors[i].is_active());
+            positions[i] = motors[i].get_data().position;
+        }
+
+        bank.step(positions.data());
+
+        for (std::size_t i = 0; i < motors.size(); ++i)
+            if (rate_due[i] and motors[i].is_active())
+                motors[i].apply_controller_output(bank, i);
+    }
+
+
+    /* sends the commands of up to 'depth' motors ahead, each refill of
+       the window with a single write, and collects the responses in
+       whatever order they arrive. Each request may wait for the bytes on
+       the bus ahead of it, the responses still outstanding, the requests
+       written before it and their responses, which extends its timeout. */
+    void execute_transactions_pipelined(std::size_t depth)
+    {
+        std::size_t head = 0, next = 0, inflight = 0;
+
+        while (true) {
+            bool enqueued = false;
+            const std::size_t first = next;
+            std::size_t ahead = 0; /* bytes */
+            for (std::size_t i = head; i < first; ++i)
+                if (motors[i].is_awaiting_response()) ahead += motor_t::response_bytes(poll_sensor[i]);
+            for (; next < motors.size() and inflight < depth; ++next)
+                if (transact[next]) {
+                    ahead += motors[next].request_bytes(poll_sensor[next]);
+                    motors[next].transmit(/*flush=*/false, poll_sensor[next], transfer_us(ahead));
+                    ahead += motor_t::response_bytes(poll_sensor[next]);
+                    enqueued = true;
+                    ++inflight;
+                }
+            if (enqueued) {
+                com.read_msg(); // read all whats left
+                if (not com.send_msg()) {
+                    ++timing.send_errors;
+                    for (std::size_t i = first; i < next; ++i) motors[i].abort_request();
+                }
             }
+
+            receive_data();
+
+            clock_t::time_point deadline;
+            inflight = update_pending(head, next, deadline);
+
+            if (inflight == 0 and next == motors.size())
+                break;
+            if (inflight > 0)
+                com.wait_for_data(deadline);
         }
+    }
 
-        if (verbose)
-            printf("| e=%u t=%u\n", errors, timeouts);
+    /* selects the motors whose external sensor is polled in this cycle */
+    void schedule_external_sensors(void)
+    {
+        std::fill(poll_sensor.begin(), poll_sensor.end(), 0);
+        if (cyclecounter % sensor_divisor != 0) return;
 
-        for (auto& m : motors) if (m.is_active())
-            m.execute_controller();
+        std::size_t count = 0;
+        for (std::size_t k = 0; k < motors.size(); ++k) {
+            const std::size_t i = (next_sensor_id + k) % motors.size();
+            if (not rate_due[i] or not motors[i].is_reading_external_sensor()) continue;
+            poll_sensor[i] = 1;
+            if (++count == sensor_per_cycle) {
+                next_sensor_id = (i + 1) % motors.size();
+                break;
+            }
+        }
     }
 
+    /* selects the active motors whose rate group is serviced in this cycle */
+    void schedule_rate_groups(uint64_t cycle)
+    {
+        for (std::size_t i = 0; i < motors.size(); ++i)
+            rate_due[i] = motors[i].is_active() and (cycle % rate_divisor[i] == rate_phase[i]);
+    }
+
+    /* selects the motors of the serviced rate groups which are due for a transaction,
+       polling the external sensor forces one */
+    void schedule_transactions(void)
+    {
+        for (std::size_t i = 0; i < motors.size(); ++i)
+            transact[i] = rate_due[i] and motors[i].is_transaction_due(poll_sensor[i]);
+    }
+
+    /* assigns the phases of the rate groups: over the hyperperiod (the least common
+       multiple of the divisors, at most max_hyperperiod cycles) the motors are placed
+       one after another, the present ones and the faster groups first, each in the
+       phase whose cycles have the least transactions so far */
+    void update_rate_schedule(void)
+    {
+        rate_schedule_changed = false;
+        std::size_t period = 1;
+        for (std::size_t d : rate_divisor) {
+            period = period / gcd(period, d) * d;
+            if (period > max_hyperperiod) { period = max_hyperperiod; break; }
+        }
+
+        std::vector<std::size_t> order(motors.size());
+        for (std::size_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [this](std::size_t a, std::size_t b) {
+            return std::make_pair(not is_present(a), rate_divisor[a]) < std::make_pair(not is_present(b), rate_divisor[b]);
+        });
+
+        std::vector<unsigned> load(period, 0);
+        for (std::size_t i : order) {
+            const std::size_t d = rate_divisor[i];
+            std::size_t best = 0;
+            unsigned best_load = std::numeric_limits<unsigned>::max();
+            for (std::size_t p = 0; p < std::min(d, period); ++p) {
+                unsigned peak = 0;
+                for (std::size_t c = p; c < period; c += d) peak = std::max(peak, load[c]);
+                if (peak < best_load) { best_load = peak; best = p; }
+            }
+            rate_phase[i] = best;
+            for (std::size_t c = best; c < period; c += d) ++load[c];
+        }
+    }
+
+    /* time to transfer the bytes at the baud rate of the transport, 8N1 */
+    unsigned transfer_us(std::size_t bytes) const {
+        const uint64_t baud = com.get_baudrate();
+        return baud ? static_cast<unsigned>((bytes * 10 * 1000000ull + baud - 1) / baud) : 0;
+    }
+
+    static std::size_t gcd(std::size_t a, std::size_t b) { while (b) { const std::size_t t = a % b; a = b; b = t; } return a; }
+
+    /* finalizes the completed or timed-out requests of the motors in [head, next),
+       advances head, returns the number still pending and their earliest deadline */
+    std::size_t update_pending(std::size_t& head, std::size_t next, clock_t::time_point& deadline)
+    {
+        const auto now = clock_t::now();
+        std::size_t inflight = 0;
+        deadline = clock_t::time_point::max();
+        for (std::size_t i = head; i < next; ++i)
+            if (motors[i].update_pending(now)) {
+                ++inflight;
+                deadline = std::min(deadline, motors[i].response_deadline());
+            }
+        while (head < next and not motors[head].is_awaiting_response()) ++head;
+        return inflight;
+    }
+
+    /* pings the motors in [first, first + count) with wrap-around in a single write
+       and collects the replies, returns the number of motors responding */
+    unsigned ping_burst(std::size_t first, std::size_t count)
+    {
+        std::size_t ahead = 0; /* bytes, see execute_transactions_pipelined */
+        for (std::size_t k = 0; k < count; ++k) {
+            ahead += motor_t::ping_bytes;
+            motors[(first + k) % motors.size()].transmit_ping(transfer_us(ahead));
+            ahead += motor_t::ping_response_bytes;
+        }
+        com.read_msg(); // read all whats left
+        com.send_msg();
+
+        std::size_t inflight = count;
+        clock_t::time_point deadline = clock_t::now();
+        while (inflight > 0) {
+            com.wait_for_data(deadline);
+            receive_data();
+            inflight = 0;
+            deadline = clock_t::time_point::max();
+            const auto now = clock_t::now();
+            for (std::size_t k = 0; k < count; ++k) {
+                auto& m = motors[(first + k) % motors.size()];
+                if (m.update_pending(now)) {
+                    ++inflight;
+                    deadline = std::min(deadline, m.response_deadline());
+                }
+            }
+        }
+
+        unsigned responding = 0;
+        for (std::size_t k = 0; k < count; ++k)
+            responding += motors[(first + k) % motors.size()].is_active();
+        return responding;
+    }
+
+    /* pings the quarantined motors whose probation is due, one after another */
+    void probe_quarantined(void)
+    {
+        for (auto& m : motors)
+            if (m.is_quarantined() and m.is_probation_due() and m.probe() and verbose)
+                sts_msg("motor %u answered on probation.", m.get_id());
+    }
+
+    /* found by a scan, quarantined motors included */
+    bool is_present(std::size_t i) const { return motors[i].is_active() or motors[i].is_quarantined(); }
+
+    /* pings a few inactive ids per cycle in one burst, quarantined ones are left to their probation */
+    void reprobe_inactive(void)
+    {
+        if (num_active_motors >= motors.size()) return;
+
+        /* skip to the next inactive id and probe the inactive ones following it */
+        for (std::size_t k = 0; k < motors.size() and is_present(next_probe_id); ++k)
+            next_probe_id = (next_probe_id + 1) % motors.size();
+
+        std::size_t count = 0;
+        while (count < reprobe_per_cycle and count < motors.size()
+               and not is_present((next_probe_id + count) % motors.size()))
+            ++count;
+
+        const unsigned found = ping_burst(next_probe_id, count);
+        if (found > 0) {
+            num_active_motors += found;
+            if (verbose) sts_msg("found %u motor(s) while re-probing.", found);
+        }
+        next_probe_id = (next_probe_id + count) % motors.size();
+    }
+
+    /* reads all bytes received so far, decodes the complete frames of any
+       motor at once and dispatches them by motor id */
+    void receive_data(void) {
+        com.read_msg();
+        const byte_span received = com.peek(com.size());
+        const std::size_t processed = frame_decoder::scan(received,
+            [&](byte_span frame, bool checksum_ok) {
+                const uint8_t mid = frame[1];
+                if (mid < motors.size() and motors[mid].is_awaiting_response())
+                    motors[mid].dispatch_response(frame, checksum_ok,
+                                                  com.arrival_time(frame.data + frame.size - 1 - received.data));
+                /* else: unexpected response, skip */
+            },
+            [this]() { ++timing.unknown_commands; });
+        com.consume(processed);
+    }
+
+    /* waits for the given time on the bus, discarding bytes which arrive
+       in the meantime, e.g. late responses of timed-out transactions */
+    void idle(uint64_t duration_us) {
+        idle_until(communication_interface::clock_t::now() + std::chrono::microseconds(duration_us));
+    }
+
+    void idle_until(communication_interface::clock_t::time_point deadline) {
+        while (com.wait_for_data(deadline)) {
+            com.read_msg();
+            com.consume(com.size());
+        }
+    }
+
+    /* discards what has arrived so far, without waiting */
+    void drain(void) {
+        com.read_msg();
+        com.consume(com.size());
+    }
 
     unsigned scan_for_motors() {
         rescan_for_motors = false;
-        printf("scanning: ");
+        char line[16 + 3*max_boards] = "scanning: ";
+        std::size_t len = strlen(line);
         num_active_motors = 0;
+        if (fast_discovery and not motors.empty())
+            ping_burst(0, motors.size());
         for (auto& m : motors) {
-            if (m.ping()) {
+            if (fast_discovery ? m.is_active() : m.ping()) {
                 ++num_active_motors;
-                printf("%02u ",m.get_id());
+                len += snprintf(line + len, sizeof(line) - len, "%02u ", m.get_id());
             }
         }
-        printf("\n");
+        sts_msg("%s", line);
         return num_active_motors;
     }
 
+    /* passes the response times of the cycle to the logger, which formats them */
+    void log_verbose(uint64_t cycle) const {
+        cycle_log line;
+        line.cycle = cycle;
+        line.errors = line.timeouts = line.count = 0;
+        for (auto& m : motors) if (m.is_active()) {
+            auto const& stats = m.get_stats();
+            line.errors += stats.errors;
+            line.timeouts += stats.timeouts;
+
+            cycle_log::entry& e = line.motor[line.count++];
+            e.id = m.get_id();
+            e.faulted = stats.faulted;
+            e.value = stats.faulted ? static_cast<unsigned>(m.get_syncstate()) : std::min(65535u, stats.response_time_us);
+        }
+        log_cycle(line);
+    }
+
 };
 
+template <typename Transport> const uint8_t basic_motorcord<Transport>::max_boards;
+template <typename Transport> const std::size_t basic_motorcord<Transport>::max_hyperperiod;
+
+/* runtime-polymorphic, as used by the shared library */
+typedef basic_motorcord<> motorcord;
+
+/* compile-time-specialized on the serial transport */
+typedef basic_motorcord<communication_controller<1000000>> serial_motorcord;
+
 } /* namespace supreme */
 
 #endif /* SUPREME_MOTORCORD_HPP */
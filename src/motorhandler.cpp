@@ -10,8 +10,11 @@
 */
 
 #include "common/log_messages.h"
-#include "common/timer.h"
 #include "motorcord.hpp"
+#include "multicord.hpp"
+#include "bus_thread.hpp"
+#include "state_export.hpp"
+#include "shared_state.hpp"
 
 namespace supreme {
 
@@ -19,29 +22,400 @@ namespace constants {
     const uint64_t us_per_sec = 1000*1000;
 }
 
+/* sets controller type and setpoint of the first N (of num_motors) motors,
+   see sensorimotor_set_commands, shared by the motor cord and its clients */
+void fill_commands( command_snapshot& cmd, std::size_t num_motors, const int* mode, const double* setpoint
+                  , const double* gains, const double* limits, unsigned N )
+{
+    typedef sensorimotor::Controller_t ctrl;
+    unsigned M = std::min((unsigned)num_motors, N);
+    for (unsigned i = 0; i < M; ++i)
+    {
+        motor_setpoint& s = cmd.motor[i];
+        if (mode[i] < ctrl::none or mode[i] > ctrl::impulse) {
+            wrn_msg("Invalid controller type %d for motor %u, disabling.", mode[i], i);
+            s.controller = ctrl::none;
+        }
+        else s.controller = static_cast<ctrl>(mode[i]);
+
+        switch (s.controller) {
+            case ctrl::voltage:
+                s.target_voltage = setpoint[i];
+                break;
+            case ctrl::position:
+                s.target_position = setpoint[i];
+                if (gains) { s.Kp = gains[2*i]; s.Ki = gains[2*i+1]; }
+                break;
+            case ctrl::csl:
+                s.csl_mode = setpoint[i];
+                if (gains) s.csl_fb = gains[2*i];
+                break;
+            case ctrl::impulse:
+                s.impulse_value = setpoint[i];
+                s.impulse_duration = gains ? static_cast<unsigned>(gains[2*i]) : 5;
+                ++s.impulse_seq;
+                break;
+            default:
+                break;
+        }
+
+        if (limits) {
+            s.lim_disable_lo = limits[2*i];
+            s.lim_disable_hi = limits[2*i+1];
+        }
+    }
+}
+
 class Motorhandler {
 public:
-    Motorhandler(unsigned number_of_motors, double update_rate_Hz, bool verbose)
-    : motors(std::min(128u,number_of_motors), verbose)
-    , timer( static_cast<uint64_t>(constants::us_per_sec/update_rate_Hz), /*enable=*/true )
+    Motorhandler(unsigned number_of_motors, double update_rate_Hz, bool verbose, serial_options const& options = serial_options())
+    : motors(std::min(128u,number_of_motors), verbose, options)
+    , bus(motors, static_cast<uint64_t>(constants::us_per_sec/update_rate_Hz))
+    , state(motors.size())
     {
+        log_start_async(); /* no blocking writes to stdout from the bus thread */
         sts_msg("Done starting motor cord at %.2f Hz.", update_rate_Hz);
         /**TODO perform a communication test before sending pwm values to the motors. */
     }
 
-    void execute_cycle()
+    /* returns false if the bus thread is running or writing to the bus failed */
+    bool execute_cycle()
+    {
+        if (not bus.is_running())
+            return bus.execute_cycle();
+        wrn_msg("Bus thread is running, ignoring execute_cycle.");
+        return false;
+    }
+
+    bool start_bus_thread(int priority, int cpu) { return bus.start(priority, cpu); }
+    void stop_bus_thread(void) { bus.stop(); }
+
+    /* call before starting the threads */
+    bool lock_memory(void) { return supreme::lock_memory(); }
+
+    bool start_rx_thread(int priority, int cpu) {
+        if (bus.is_running()) { wrn_msg("Stop bus thread before starting the receive thread."); return false; }
+        serial_t* com = dynamic_cast<serial_t*>(&motors.get_transport());
+        if (com == NULL) { wrn_msg("Transport has no receive thread."); return false; }
+        return com->start_rx_thread(priority, cpu);
+    }
+
+    void stop_rx_thread(void) {
+        if (bus.is_running()) { wrn_msg("Stop bus thread before stopping the receive thread."); return; }
+        serial_t* com = dynamic_cast<serial_t*>(&motors.get_transport());
+        if (com != NULL) com->stop_rx_thread();
+    }
+
+    void set_position(double* data, unsigned N)
+    {
+        bus.write_setpoints([&](command_snapshot& cmd) {
+            unsigned M = std::min((unsigned)motors.size(), N);
+            for (unsigned i = 0; i < M; ++i)
+            {
+                cmd.motor[i].controller = supreme::sensorimotor::Controller_t::position;
+                cmd.motor[i].target_position = data[i];
+            }
+        });
+    }
+
+    void set_voltage_limit(double* data, unsigned N)
+    {
+        bus.write_setpoints([&](command_snapshot& cmd) {
+            unsigned M = std::min((unsigned)motors.size(), N);
+            for (unsigned i = 0; i < M; ++i) {
+                cmd.motor[i].voltage_limit = data[i];
+                ++cmd.motor[i].voltage_limit_seq;
+            }
+        });
+    }
+
+    void apply_impulse(double* data, unsigned N)
+    {
+        bus.write_setpoints([&](command_snapshot& cmd) {
+            unsigned M = std::min((unsigned)motors.size(), N);
+            for (unsigned i = 0; i < M; ++i)
+            {
+                cmd.motor[i].controller = supreme::sensorimotor::Controller_t::impulse;
+                cmd.motor[i].lim_disable_lo = -1.0;
+                cmd.motor[i].lim_disable_hi = +1.0;
+                cmd.motor[i].impulse_value = data[i];
+                cmd.motor[i].impulse_duration = 5/**TODO duration*/;
+                ++cmd.motor[i].impulse_seq;
+            }
+        });
+    }
+
+    /* sets controller type and setpoint of the first N motors individually,
+       all changes are published together and take effect at the next cycle,
+       see sensorimotor_set_commands for the meaning of setpoint and gains */
+    void set_commands(const int* mode, const double* setpoint, const double* gains, const double* limits, unsigned N)
+    {
+        bus.write_setpoints([&](command_snapshot& cmd) {
+            fill_commands(cmd, motors.size(), mode, setpoint, gains, limits, N);
+        });
+    }
+
+    /* lockstep: applies the commands of the first N motors (if any), runs exactly one
+       cycle and copies its state to the observations: cycle, timestamp in seconds,
+       followed by the state table of the first M motors, see state_export. Without
+       pacing the cycle starts immediately and returns as soon as the transactions are done. */
+    long long step( const int* mode, const double* setpoint, const double* gains, const double* limits, unsigned N
+                  , double* observations, unsigned M, bool paced )
+    {
+        if (bus.is_running()) {
+            wrn_msg("Bus thread is running, stop it before stepping.");
+            return -1;
+        }
+        if (mode != NULL and setpoint != NULL)
+            set_commands(mode, setpoint, gains, limits, N);
+
+        bus.execute_cycle(paced);
+
+        update_state();
+        if (observations != NULL) {
+            observations[0] = static_cast<double>(state.cycle());
+            observations[1] = state.timestamp();
+            state.copy_to(observations + 2, M);
+        }
+        return state.cycle();
+    }
+
+    void get_motor_data(double* data, unsigned N)
+    {
+        bus.read_state([&](state_snapshot const& state) {
+            unsigned M = std::min((unsigned)state.num_motors, N);
+            for (unsigned i = 0; i < M; ++i)
+            {
+                data[i] = state.motor[i].position; /**TODO other data as well*/
+            }
+        });
+    }
+
+    /* refreshes the exported state table, returns the cycle of the snapshot */
+    uint64_t update_state(void) {
+        bus.read_state([&](state_snapshot const& snapshot) { state.update(snapshot); });
+        return state.cycle();
+    }
+
+    const double* get_state_table(void) const { return state.data(); }
+
+    /* copies the phase durations of the last cycle in the order of cycle_timing */
+    void get_cycle_timing(double* data, unsigned N)
+    {
+        bus.read_state([&](state_snapshot const& snapshot) {
+            cycle_timing const& t = snapshot.timing;
+            const double values[] = { static_cast<double>(t.cycle), (double) t.send_us, (double) t.wait_us
+                                    , (double) t.read_us, (double) t.parse_us, (double) t.controller_us
+                                    , (double) t.total_us, (double) t.slack_us, (double) t.unknown_commands
+                                    , (double) t.lateness_us, (double) t.overruns, (double) t.skipped
+                                    , (double) t.send_errors };
+            const unsigned M = std::min<unsigned>(N, sizeof(values)/sizeof(values[0]));
+            std::copy(values, values + M, data);
+        });
+    }
+
+    /* copies the response time histograms, motor after motor */
+    void get_histograms(unsigned* data, unsigned N)
+    {
+        bus.read_state([&](state_snapshot const& snapshot) {
+            const unsigned B = Statistics_t::histogram_size;
+            const unsigned M = std::min<unsigned>(snapshot.num_motors, N / B);
+            for (unsigned i = 0; i < M; ++i)
+                std::copy(snapshot.motor[i].statistics.histogram, snapshot.motor[i].statistics.histogram + B, data + i*B);
+        });
+    }
+    unsigned get_number_of_motors(void) const { return motors.size(); }
+
+    bool set_pipeline_depth(unsigned depth) {
+        if (bus.is_running()) { wrn_msg("Stop bus thread before changing the pipeline depth."); return false; }
+        motors.set_pipeline_depth(depth);
+        return true;
+    }
+
+    void set_bulk_commands(bool enable) {
+        if (bus.is_running()) wrn_msg("Stop bus thread before changing the bulk mode.");
+        else motors.set_bulk_commands(enable);
+    }
+
+    void set_discovery(bool fast, unsigned reprobe_per_cycle) {
+        if (bus.is_running()) wrn_msg("Stop bus thread before changing the discovery mode.");
+        else {
+            motors.set_fast_discovery(fast);
+            motors.set_reprobe_per_cycle(reprobe_per_cycle);
+        }
+    }
+
+    /* applies to all motors, or to a single motor if id < number of motors */
+    void set_timeout_settings(timeout_settings const& s, unsigned id) {
+        if (bus.is_running()) wrn_msg("Stop bus thread before changing the timeout settings.");
+        else if (id < motors.size()) motors[id].set_timeout_settings(s);
+        else motors.set_timeout_settings(s);
+    }
+
+    bool start_recording(const char* path, uint64_t capacity, bool ring) {
+        if (bus.is_running()) { wrn_msg("Stop bus thread before starting a recording."); return false; }
+        motors.set_recorder(NULL);
+        if (not recorder.open(path, motors.size(), capacity, ring)) return false;
+        motors.set_recorder(&recorder);
+        return true;
+    }
+
+    void stop_recording(void) {
+        if (bus.is_running()) { wrn_msg("Stop bus thread before stopping the recording."); return; }
+        motors.set_recorder(NULL);
+        recorder.close();
+    }
+
+    bool start_capture(const char* path, uint64_t capacity) {
+        if (bus.is_running()) { wrn_msg("Stop bus thread before starting a capture."); return false; }
+        supreme::buffered_communication* com = dynamic_cast<supreme::buffered_communication*>(&motors.get_transport());
+        if (com == NULL) { wrn_msg("Transport does not support capturing."); return false; }
+        com->set_capture(NULL);
+        if (not capture.open(path, capacity)) return false;
+        com->set_capture(&capture);
+        return true;
+    }
+
+    void stop_capture(void) {
+        if (bus.is_running()) { wrn_msg("Stop bus thread before stopping the capture."); return; }
+        supreme::buffered_communication* com = dynamic_cast<supreme::buffered_communication*>(&motors.get_transport());
+        if (com != NULL) com->set_capture(NULL);
+        capture.close();
+    }
+
+    void set_deadline_policy(int policy) {
+        if (bus.is_running()) wrn_msg("Stop bus thread before changing the deadline policy.");
+        else if (policy == supreme::periodic_scheduler::skip or policy == supreme::periodic_scheduler::catch_up)
+            bus.set_deadline_policy(static_cast<supreme::periodic_scheduler::policy_t>(policy));
+        else wrn_msg("Invalid deadline policy %d.", policy);
+    }
+
+    /* applies to all motors, or to a single motor if id < number of motors,
+       values in the order of sensor_calibration, missing ones are kept */
+    void set_calibration(unsigned id, const double* values, unsigned N) {
+        if (bus.is_running()) { wrn_msg("Stop bus thread before changing the calibration."); return; }
+        for (unsigned i = 0; i < motors.size(); ++i) {
+            if (id < motors.size() and i != id) continue;
+            double v[supreme::sensor_calibration::num_values];
+            motors[i].get_calibration().get(v);
+            std::copy(values, values + std::min<unsigned>(N, supreme::sensor_calibration::num_values), v);
+            supreme::sensor_calibration c;
+            c.set(v);
+            motors[i].set_calibration(c);
+        }
+    }
+
+    unsigned get_calibration(unsigned id, double* values, unsigned N) const {
+        if (id >= motors.size()) return 0;
+        double v[supreme::sensor_calibration::num_values];
+        motors[id].get_calibration().get(v);
+        const unsigned M = std::min<unsigned>(N, supreme::sensor_calibration::num_values);
+        std::copy(v, v + M, values);
+        return M;
+    }
+
+    /* applies to all motors, or to a single motor if id < number of motors */
+    void set_external_sensor(unsigned id, bool enable) {
+        if (bus.is_running()) { wrn_msg("Stop bus thread before changing the external sensor readout."); return; }
+        for (unsigned i = 0; i < motors.size(); ++i)
+            if (id >= motors.size() or i == id) motors[i].set_ext_sensor_readout(enable);
+    }
+
+    void set_health_settings(supreme::health_settings const& s) {
+        if (bus.is_running()) wrn_msg("Stop bus thread before changing the health settings.");
+        else motors.set_health_settings(s);
+    }
+
+    /* applies to all motors, or to a single motor if id < number of motors */
+    void set_rate_divisor(unsigned id, unsigned divisor) {
+        if (bus.is_running()) { wrn_msg("Stop bus thread before changing the rate groups."); return; }
+        for (unsigned i = 0; i < motors.size(); ++i)
+            if (id >= motors.size() or i == id) motors.set_rate_divisor(i, divisor);
+    }
+
+    void set_suppression_settings(supreme::suppression_settings const& s) {
+        if (bus.is_running()) wrn_msg("Stop bus thread before changing the command suppression.");
+        else motors.set_suppression_settings(s);
+    }
+
+    void set_external_sensor_schedule(unsigned divisor, unsigned per_cycle) {
+        if (bus.is_running()) wrn_msg("Stop bus thread before changing the external sensor schedule.");
+        else motors.set_external_sensor_schedule(divisor, per_cycle);
+    }
+
+    void set_deferred_decoding(bool enable) {
+        if (bus.is_running()) wrn_msg("Stop bus thread before changing the decoding mode.");
+        else motors.set_deferred_decoding(enable);
+    }
+
+    /* serves the state to other processes and takes the setpoints of one of them, see state_server */
+    bool start_server(const char* name, unsigned command_mode) {
+        if (bus.is_running()) { wrn_msg("Stop bus thread before starting the server."); return false; }
+        if (not server.open(name, motors.size(), command_mode)) return false;
+        bus.set_endpoint(&server);
+        return true;
+    }
+
+    void stop_server(void) {
+        if (bus.is_running()) { wrn_msg("Stop bus thread before stopping the server."); return; }
+        bus.set_endpoint(NULL);
+        server.close();
+    }
+
+    void set_controller_bank(bool enable) {
+        if (bus.is_running()) wrn_msg("Stop bus thread before changing the controller bank mode.");
+        else motors.set_controller_bank(enable);
+    }
+
+    uint8_t ping() {
+        if (not bus.is_running())
+            return motors.scan_for_motors();
+
+        /* the bus thread owns the motors, report the last known state */
+        uint8_t num_active = 0;
+        bus.read_state([&](state_snapshot const& state) {
+            for (unsigned i = 0; i < state.num_motors; ++i)
+                num_active += state.active[i];
+        });
+        return num_active;
+    }
+
+    ~Motorhandler() { bus.stop(); sts_msg("Done stopping motor cord."); log_stop_async(); }
+
+private:
+    typedef supreme::communication_controller<1000000> serial_t;
+
+    supreme::telemetry_recorder recorder; /* outlives the motors, which record while disabled */
+    supreme::bus_capture        capture;  /* outlives the motors, which are disabled via the bus */
+    supreme::state_server       server;
+    supreme::motorcord  motors;
+    supreme::bus_thread bus;
+    supreme::state_export state;
+};
+
+/* motors distributed over several buses, see multicord, cycles are run by the caller */
+class MultiMotorhandler {
+public:
+    MultiMotorhandler(unsigned number_of_motors, double update_rate_Hz, bool verbose, std::vector<serial_options> const& buses)
+    : motors(std::min(128u,number_of_motors), buses, verbose)
+    , scheduler(static_cast<uint64_t>(constants::us_per_sec/update_rate_Hz))
     {
-        motors.execute_cycle();
+        sts_msg("Done starting motor cord with %zu buses at %.2f Hz.", motors.number_of_buses(), update_rate_Hz);
+    }
 
-        while(!timer.check_if_timed_out_and_restart())
-            usleep(100);
+    /* waits for the next deadline, returns false if writing to any bus failed */
+    bool execute_cycle()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        scheduler.wait([this](periodic_scheduler::clock_t::time_point deadline) { motors.idle_until(deadline); });
+        return motors.execute_cycle();
     }
 
     void set_position(double* data, unsigned N)
     {
+        std::lock_guard<std::mutex> lock(mtx);
         unsigned M = std::min((unsigned)motors.size(), N);
-        for (unsigned i = 0; i < M; ++i)
-        {
+        for (unsigned i = 0; i < M; ++i) {
             motors[i].set_controller_type(supreme::sensorimotor::Controller_t::position);
             motors[i].set_target_position(data[i]);
         }
@@ -49,40 +423,46 @@ public:
 
     void set_voltage_limit(double* data, unsigned N)
     {
+        std::lock_guard<std::mutex> lock(mtx);
         unsigned M = std::min((unsigned)motors.size(), N);
         for (unsigned i = 0; i < M; ++i)
             motors[i].set_voltage_limit(data[i]);
     }
 
-    void apply_impulse(double* data, unsigned N)
+    void get_motor_data(double* data, unsigned N)
     {
+        std::lock_guard<std::mutex> lock(mtx);
         unsigned M = std::min((unsigned)motors.size(), N);
         for (unsigned i = 0; i < M; ++i)
-        {
-            motors[i].set_controller_type(supreme::sensorimotor::Controller_t::impulse);
-            motors[i].set_disable_position_limits(-1.0,+1.0);
-            motors[i].apply_impulse(data[i], 5/**TODO duration*/);
-        }
+            data[i] = motors[i].get_data().position;
     }
 
-    void get_motor_data(double* data, unsigned N)
-    {
-        unsigned M = std::min((unsigned)motors.size(), N);
-        for (unsigned i = 0; i < M; ++i)
-        {
-            data[i] = motors[i].get_data().position; /**TODO other data as well*/
-        }
+    void set_reprobe_per_cycle(unsigned n) {
+        std::lock_guard<std::mutex> lock(mtx);
+        motors.set_reprobe_per_cycle(n);
+    }
+
+    unsigned get_number_of_motors(void) const { return motors.size(); }
+    unsigned get_number_of_buses(void) const { return motors.number_of_buses(); }
+
+    /* bus index of a motor, -1 if not found on any bus */
+    int get_bus(unsigned id) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (id >= motors.size() or not motors.is_found(id)) return -1;
+        return motors.get_bus(id);
     }
 
     uint8_t ping() {
+        std::lock_guard<std::mutex> lock(mtx);
         return motors.scan_for_motors();
     }
 
-    ~Motorhandler() { sts_msg("Done stopping motor cord."); }
+    ~MultiMotorhandler() { sts_msg("Done stopping motor cord."); }
 
 private:
-    supreme::motorcord motors;
-    supreme::SimpleTimer timer;
+    std::mutex         mtx; /* cycles and accesses from different threads */
+    multicord          motors;
+    periodic_scheduler scheduler;
 };
 
 } /* namespace supreme */
@@ -94,6 +474,21 @@ extern "C" {
         return new supreme::Motorhandler(number_of_motors, update_rate_Hz, verbose);
     }
 
+    /* device is a name ("ttyUSB0") or path, NULL or empty for the default devices,
+       baudrate 0 selects the default rate, latency_timer_ms < 0 leaves the timer unchanged */
+    supreme::Motorhandler* sensorimotor_new_with_options( unsigned number_of_motors, double update_rate_Hz, bool verbose
+                                                        , const char* device, unsigned baudrate
+                                                        , bool low_latency, int latency_timer_ms )
+    {
+        sts_msg("Starting motor cord.");
+        supreme::serial_options options;
+        if (device != NULL) options.device = device;
+        options.baudrate         = baudrate;
+        options.low_latency      = low_latency;
+        options.latency_timer_ms = latency_timer_ms;
+        return new supreme::Motorhandler(number_of_motors, update_rate_Hz, verbose, options);
+    }
+
     int sensorimotor_del(supreme::Motorhandler* sensorimotor)
     {
         sts_msg("Stopping motor cord.");
@@ -104,10 +499,10 @@ extern "C" {
         return true;
     }
 
+    /* returns 1 if the cycle was not executed (bus thread running) or writing to the bus failed */
     int sensorimotor_execute_cycle(supreme::Motorhandler* sensorimotor) {
         if (sensorimotor != NULL) {
-            sensorimotor->execute_cycle();
-            return 0;
+            return sensorimotor->execute_cycle() ? 0 : 1;
         } else {
             wrn_msg("Motor cord already stopped (execute_cycle).");
             return -1;
@@ -144,6 +539,45 @@ extern "C" {
         }
     }
 
+    /* sets the controller types and setpoints of the first N motors at once:
+       mode    : N controller types, 0: none, 1: voltage, 2: position, 3: csl, 4: impulse
+       setpoint: N values, target voltage, target position, csl mode or impulse value
+       gains   : 2N values or NULL (unchanged), position: Kp, Ki, csl: feedback, -,
+                 impulse: duration in cycles, -
+       limits  : 2N values or NULL (unchanged), position range lo, hi, outside the motor is disabled
+       every call with mode impulse starts a new impulse */
+    int sensorimotor_set_commands( supreme::Motorhandler* sensorimotor, const int* mode, const double* setpoint
+                                 , const double* gains, const double* limits, unsigned N )
+    {
+        if (mode == NULL or setpoint == NULL) {
+            wrn_msg("Modes and setpoints are required (set_commands).");
+            return -1;
+        }
+        if (sensorimotor != NULL) {
+            sensorimotor->set_commands(mode, setpoint, gains, limits, N);
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (set_commands).");
+            return -1;
+        }
+    }
+
+    /* sets the commands of N motors as sensorimotor_set_commands (mode and setpoint may
+       be NULL), runs one cycle and fills the observations (may be NULL) with
+       2 + sensorimotor_get_state_fields() * M values: cycle, timestamp, state table,
+       returns the cycle number, or -1 on error, e.g. while the bus thread is running */
+    long long sensorimotor_step( supreme::Motorhandler* sensorimotor, const int* mode, const double* setpoint
+                               , const double* gains, const double* limits, unsigned N
+                               , double* observations, unsigned M, bool paced )
+    {
+        if (sensorimotor != NULL) {
+            return sensorimotor->step(mode, setpoint, gains, limits, N, observations, M, paced);
+        } else {
+            wrn_msg("Motor cord already stopped (step).");
+            return -1;
+        }
+    }
+
     int sensorimotor_get_motor_data(supreme::Motorhandler* sensorimotor, double* data, unsigned N) {
         if (sensorimotor != NULL) {
             sensorimotor->get_motor_data(data, N);
@@ -154,9 +588,537 @@ extern "C" {
         }
     }
 
+    /* returns the number of rows of the state table, see state_export::field_t */
+    unsigned sensorimotor_get_state_fields(void) { return supreme::state_export::num_fields; }
+
+    unsigned sensorimotor_get_number_of_motors(supreme::Motorhandler* sensorimotor) {
+        if (sensorimotor == NULL) return 0;
+        return sensorimotor->get_number_of_motors();
+    }
+
+    /* returns a pointer to the table of fields x motors doubles, valid until sensorimotor_del */
+    const double* sensorimotor_get_state_table(supreme::Motorhandler* sensorimotor) {
+        if (sensorimotor == NULL) return NULL;
+        return sensorimotor->get_state_table();
+    }
+
+    /* copies the latest state into the table, returns the cycle counter of that state */
+    long long sensorimotor_update_state(supreme::Motorhandler* sensorimotor) {
+        if (sensorimotor != NULL) {
+            return sensorimotor->update_state();
+        } else {
+            wrn_msg("Motor cord already stopped (update_state).");
+            return -1;
+        }
+    }
+
+    /* fills data with up to N values: cycle, send, wait, read, parse, controller, total, slack (us),
+       the accumulated unknown command bytes, the wake-up lateness (us) and the accumulated
+       overruns, skipped deadlines and failed writes, see cycle_timing */
+    int sensorimotor_get_cycle_timing(supreme::Motorhandler* sensorimotor, double* data, unsigned N) {
+        if (sensorimotor != NULL) {
+            sensorimotor->get_cycle_timing(data, N);
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (get_cycle_timing).");
+            return -1;
+        }
+    }
+
+    unsigned sensorimotor_get_histogram_size(void) { return supreme::Statistics_t::histogram_size; }
+
+    /* fills data with the response time histograms of N / histogram size motors */
+    int sensorimotor_get_histograms(supreme::Motorhandler* sensorimotor, unsigned* data, unsigned N) {
+        if (sensorimotor != NULL) {
+            sensorimotor->get_histograms(data, N);
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (get_histograms).");
+            return -1;
+        }
+    }
+
+    int sensorimotor_start_bus_thread(supreme::Motorhandler* sensorimotor, int priority, int cpu) {
+        if (sensorimotor != NULL) {
+            return sensorimotor->start_bus_thread(priority, cpu) ? 0 : -1;
+        } else {
+            wrn_msg("Motor cord already stopped (start_bus_thread).");
+            return -1;
+        }
+    }
+
+    int sensorimotor_stop_bus_thread(supreme::Motorhandler* sensorimotor) {
+        if (sensorimotor != NULL) {
+            sensorimotor->stop_bus_thread();
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (stop_bus_thread).");
+            return -1;
+        }
+    }
+
+    int sensorimotor_set_log_rate_limit(supreme::Motorhandler* sensorimotor, unsigned lines_per_s, unsigned burst) {
+        if (sensorimotor != NULL) {
+            log_set_rate_limit(lines_per_s, burst);
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (set_log_rate_limit).");
+            return -1;
+        }
+    }
+
+    int sensorimotor_lock_memory(supreme::Motorhandler* sensorimotor) {
+        if (sensorimotor != NULL) {
+            return sensorimotor->lock_memory() ? 0 : -1;
+        } else {
+            wrn_msg("Motor cord already stopped (lock_memory).");
+            return -1;
+        }
+    }
+
+    int sensorimotor_start_rx_thread(supreme::Motorhandler* sensorimotor, int priority, int cpu) {
+        if (sensorimotor != NULL) {
+            return sensorimotor->start_rx_thread(priority, cpu) ? 0 : -1;
+        } else {
+            wrn_msg("Motor cord already stopped (start_rx_thread).");
+            return -1;
+        }
+    }
+
+    int sensorimotor_stop_rx_thread(supreme::Motorhandler* sensorimotor) {
+        if (sensorimotor != NULL) {
+            sensorimotor->stop_rx_thread();
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (stop_rx_thread).");
+            return -1;
+        }
+    }
+
+    int sensorimotor_set_pipeline_depth(supreme::Motorhandler* sensorimotor, unsigned depth) {
+        if (sensorimotor != NULL) {
+            return sensorimotor->set_pipeline_depth(depth) ? 0 : -1;
+        } else {
+            wrn_msg("Motor cord already stopped (set_pipeline_depth).");
+            return -1;
+        }
+    }
+
+    int sensorimotor_set_bulk_commands(supreme::Motorhandler* sensorimotor, bool enable) {
+        if (sensorimotor != NULL) {
+            sensorimotor->set_bulk_commands(enable);
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (set_bulk_commands).");
+            return -1;
+        }
+    }
+
+    int sensorimotor_set_discovery(supreme::Motorhandler* sensorimotor, bool fast, unsigned reprobe_per_cycle) {
+        if (sensorimotor != NULL) {
+            sensorimotor->set_discovery(fast, reprobe_per_cycle);
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (set_discovery).");
+            return -1;
+        }
+    }
+
+    /* configures the response timeout policy of motor 'id', or of all motors if id >= number of motors */
+    int sensorimotor_set_response_timeout( supreme::Motorhandler* sensorimotor, unsigned id, bool adaptive
+                                         , unsigned floor_us, unsigned ceiling_us, double sigma_factor, unsigned margin_us )
+    {
+        if (sensorimotor != NULL) {
+            supreme::timeout_settings s;
+            s.adaptive     = adaptive;
+            s.floor_us     = floor_us;
+            s.ceiling_us   = std::max(floor_us, ceiling_us);
+            s.sigma_factor = sigma_factor;
+            s.margin_us    = margin_us;
+            sensorimotor->set_timeout_settings(s, id);
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (set_response_timeout).");
+            return -1;
+        }
+    }
+
+    /* selects how missed cycle deadlines are handled: 0 skips them, keeping the phase,
+       1 catches up by running the missed cycles back to back */
+    int sensorimotor_set_deadline_policy(supreme::Motorhandler* sensorimotor, int policy) {
+        if (sensorimotor != NULL) {
+            sensorimotor->set_deadline_policy(policy);
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (set_deadline_policy).");
+            return -1;
+        }
+    }
+
+    /* sets the linear sensor calibration (gain, offset) of all motors, or of a single motor if
+       id < number of motors: current, voltage, temperature, acceleration gains x, y, z and
+       offsets x, y, z, see sensor_calibration, the first N values are applied */
+    int sensorimotor_set_calibration(supreme::Motorhandler* sensorimotor, unsigned id, const double* values, unsigned N) {
+        if (values == NULL) {
+            wrn_msg("Calibration values are required (set_calibration).");
+            return -1;
+        }
+        if (sensorimotor != NULL) {
+            sensorimotor->set_calibration(id, values, N);
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (set_calibration).");
+            return -1;
+        }
+    }
+
+    /* copies up to N calibration values of motor id, returns the number copied */
+    int sensorimotor_get_calibration(supreme::Motorhandler* sensorimotor, unsigned id, double* values, unsigned N) {
+        if (values == NULL) {
+            wrn_msg("Calibration values are required (get_calibration).");
+            return -1;
+        }
+        if (sensorimotor != NULL) {
+            return sensorimotor->get_calibration(id, values, N);
+        } else {
+            wrn_msg("Motor cord already stopped (get_calibration).");
+            return -1;
+        }
+    }
+
+    /* quarantines motors after 'quarantine_after' consecutive failed requests (0 disables),
+       pings them every 'probation_interval' cycles and considers them active again
+       after 'recover_after' consecutive successful requests */
+    int sensorimotor_set_health_settings( supreme::Motorhandler* sensorimotor, unsigned quarantine_after
+                                        , unsigned recover_after, unsigned probation_interval )
+    {
+        if (sensorimotor != NULL) {
+            supreme::health_settings s;
+            s.quarantine_after   = quarantine_after;
+            s.recover_after      = std::max(1u, recover_after);
+            s.probation_interval = std::max(1u, probation_interval);
+            sensorimotor->set_health_settings(s);
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (set_health_settings).");
+            return -1;
+        }
+    }
+
+    /* services all motors, or a single motor if id < number of motors, only every
+       'divisor' cycles, the slower motors are spread evenly over the cycles */
+    int sensorimotor_set_rate_divisor(supreme::Motorhandler* sensorimotor, unsigned id, unsigned divisor) {
+        if (sensorimotor != NULL) {
+            sensorimotor->set_rate_divisor(id, divisor);
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (set_rate_divisor).");
+            return -1;
+        }
+    }
+
+    /* skips idle motors (open loop, at rest) whose command is unchanged for up to
+       'keepalive_interval' cycles in a row, their sensors are read when their command
+       changes or is repeated, see suppression_settings */
+    int sensorimotor_set_command_suppression( supreme::Motorhandler* sensorimotor, bool enable
+                                            , unsigned keepalive_interval )
+    {
+        if (sensorimotor != NULL) {
+            supreme::suppression_settings s;
+            s.enabled            = enable;
+            s.keepalive_interval = keepalive_interval;
+            sensorimotor->set_suppression_settings(s);
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (set_command_suppression).");
+            return -1;
+        }
+    }
+
+    /* enables reading the external sensor (accelerometer) of all motors,
+       or of a single motor if id < number of motors */
+    int sensorimotor_set_external_sensor(supreme::Motorhandler* sensorimotor, unsigned id, bool enable) {
+        if (sensorimotor != NULL) {
+            sensorimotor->set_external_sensor(id, enable);
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (set_external_sensor).");
+            return -1;
+        }
+    }
+
+    /* polls the external sensors every 'divisor' cycles and, if per_cycle > 0,
+       only 'per_cycle' motors per polling cycle in round-robin order */
+    int sensorimotor_set_external_sensor_schedule(supreme::Motorhandler* sensorimotor, unsigned divisor, unsigned per_cycle) {
+        if (sensorimotor != NULL) {
+            sensorimotor->set_external_sensor_schedule(divisor, per_cycle);
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (set_external_sensor_schedule).");
+            return -1;
+        }
+    }
+
+    /* stores the sensor words only and converts them when the state is read,
+       position and velocity are always decoded for the controllers */
+    int sensorimotor_set_deferred_decoding(supreme::Motorhandler* sensorimotor, bool enable) {
+        if (sensorimotor != NULL) {
+            sensorimotor->set_deferred_decoding(enable);
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (set_deferred_decoding).");
+            return -1;
+        }
+    }
+
+    int sensorimotor_set_controller_bank(supreme::Motorhandler* sensorimotor, bool enable) {
+        if (sensorimotor != NULL) {
+            sensorimotor->set_controller_bank(enable);
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (set_controller_bank).");
+            return -1;
+        }
+    }
+
+    /* records the state of all motors after each cycle to a memory-mapped file with
+       room for 'capacity' records, in ring mode the oldest are overwritten,
+       see telemetry_recorder.hpp for the format */
+    int sensorimotor_start_recording(supreme::Motorhandler* sensorimotor, const char* path, unsigned long long capacity, bool ring) {
+        if (sensorimotor != NULL) {
+            return sensorimotor->start_recording(path, capacity, ring) ? 0 : -1;
+        } else {
+            wrn_msg("Motor cord already stopped (start_recording).");
+            return -1;
+        }
+    }
+
+    int sensorimotor_stop_recording(supreme::Motorhandler* sensorimotor) {
+        if (sensorimotor != NULL) {
+            sensorimotor->stop_recording();
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (stop_recording).");
+            return -1;
+        }
+    }
+
+    /* captures the raw bytes sent to and received from the bus to a memory-mapped file
+       with room for 'capacity' bytes, to be replayed by the replay_bus,
+       see bus_capture.hpp for the format */
+    int sensorimotor_start_capture(supreme::Motorhandler* sensorimotor, const char* path, unsigned long long capacity) {
+        if (sensorimotor != NULL) {
+            return sensorimotor->start_capture(path, capacity) ? 0 : -1;
+        } else {
+            wrn_msg("Motor cord already stopped (start_capture).");
+            return -1;
+        }
+    }
+
+    int sensorimotor_stop_capture(supreme::Motorhandler* sensorimotor) {
+        if (sensorimotor != NULL) {
+            sensorimotor->stop_capture();
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (stop_capture).");
+            return -1;
+        }
+    }
+
+    /* serves the state of the motors to other processes as shared memory object 'name',
+       readable by all, and takes the setpoints of one client process from 'name'.cmd,
+       writable according to command_mode (e.g. 0600: the same user only) */
+    int sensorimotor_start_server(supreme::Motorhandler* sensorimotor, const char* name, unsigned command_mode) {
+        if (sensorimotor != NULL) {
+            return sensorimotor->start_server(name, command_mode) ? 0 : -1;
+        } else {
+            wrn_msg("Motor cord already stopped (start_server).");
+            return -1;
+        }
+    }
+
+    int sensorimotor_stop_server(supreme::Motorhandler* sensorimotor) {
+        if (sensorimotor != NULL) {
+            sensorimotor->stop_server();
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (stop_server).");
+            return -1;
+        }
+    }
+
+    /* connects to the state served as 'name' by another process, a writer takes the
+       slot for setpoints, returns NULL if not served or the slot is taken */
+    supreme::state_client* sensorimotor_client_new(const char* name, bool writer) {
+        supreme::state_client* client = new supreme::state_client();
+        if (client->open(name, writer)) return client;
+        delete client;
+        return NULL;
+    }
+
+    int sensorimotor_client_del(supreme::state_client* client) {
+        if (client != NULL) {
+            delete client;
+            return 0;
+        } else {
+            wrn_msg("Client already closed (del).");
+            return -1;
+        }
+    }
+
+    unsigned sensorimotor_client_get_number_of_motors(supreme::state_client* client) {
+        return (client != NULL) ? client->size() : 0;
+    }
+
+    /* copies cycle, timestamp and the state table of the first M motors, as sensorimotor_step,
+       returns the cycle or -1 if the server stopped */
+    long long sensorimotor_client_read_state(supreme::state_client* client, double* observations, unsigned M) {
+        if (observations == NULL) {
+            wrn_msg("Observations are required (client_read_state).");
+            return -1;
+        }
+        if (client != NULL) {
+            uint64_t cycle = 0;
+            if (not client->read(cycle, observations[1], observations + 2, M)) return -1;
+            observations[0] = static_cast<double>(cycle);
+            return cycle;
+        } else {
+            wrn_msg("Client already closed (read_state).");
+            return -1;
+        }
+    }
+
+    /* as sensorimotor_set_commands, requires the client to be the writer */
+    int sensorimotor_client_set_commands( supreme::state_client* client, const int* mode, const double* setpoint
+                                        , const double* gains, const double* limits, unsigned N )
+    {
+        if (mode == NULL or setpoint == NULL) {
+            wrn_msg("Modes and setpoints are required (client_set_commands).");
+            return -1;
+        }
+        if (client != NULL) {
+            const std::size_t num_motors = client->size();
+            return client->write_setpoints([&](supreme::command_snapshot& cmd) {
+                supreme::fill_commands(cmd, num_motors, mode, setpoint, gains, limits, N);
+            }) ? 0 : -1;
+        } else {
+            wrn_msg("Client already closed (client_set_commands).");
+            return -1;
+        }
+    }
+
     int sensorimotor_ping(supreme::Motorhandler* sensorimotor) {
         if (sensorimotor == NULL) return -1;
         return sensorimotor->ping();
     }
+
+    /* devices is a comma-separated list of names ("ttyUSB0,ttyUSB1") or paths, one bus each,
+       the other options apply to all buses as in sensorimotor_new_with_options */
+    supreme::MultiMotorhandler* sensorimotor_multi_new( unsigned number_of_motors, double update_rate_Hz, bool verbose
+                                                      , const char* devices, unsigned baudrate
+                                                      , bool low_latency, int latency_timer_ms )
+    {
+        sts_msg("Starting motor cord.");
+        std::vector<supreme::serial_options> buses;
+        std::string list = (devices != NULL) ? devices : "";
+        std::size_t begin = 0;
+        while (begin <= list.size()) {
+            std::size_t end = std::min(list.find(',', begin), list.size());
+            if (end > begin) {
+                supreme::serial_options options;
+                options.device           = list.substr(begin, end - begin);
+                options.baudrate         = baudrate;
+                options.low_latency      = low_latency;
+                options.latency_timer_ms = latency_timer_ms;
+                buses.push_back(options);
+            }
+            begin = end + 1;
+        }
+        if (buses.empty()) {
+            wrn_msg("No devices given (multi_new).");
+            return NULL;
+        }
+        return new supreme::MultiMotorhandler(number_of_motors, update_rate_Hz, verbose, buses);
+    }
+
+    int sensorimotor_multi_del(supreme::MultiMotorhandler* sensorimotor)
+    {
+        sts_msg("Stopping motor cord.");
+        if (sensorimotor != NULL) {
+            delete sensorimotor;
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (multi_del).");
+            return -1;
+        }
+    }
+
+    /* waits for the next deadline and runs one cycle on all buses,
+       returns 1 if writing to any bus failed */
+    int sensorimotor_multi_execute_cycle(supreme::MultiMotorhandler* sensorimotor) {
+        if (sensorimotor != NULL) {
+            return sensorimotor->execute_cycle() ? 0 : 1;
+        } else {
+            wrn_msg("Motor cord already stopped (multi_execute_cycle).");
+            return -1;
+        }
+    }
+
+    int sensorimotor_multi_set_position(supreme::MultiMotorhandler* sensorimotor, double* data, unsigned N) {
+        if (sensorimotor != NULL) {
+            sensorimotor->set_position(data, N);
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (multi_set_position).");
+            return -1;
+        }
+    }
+
+    int sensorimotor_multi_set_voltage_limit(supreme::MultiMotorhandler* sensorimotor, double* data, unsigned N) {
+        if (sensorimotor != NULL) {
+            sensorimotor->set_voltage_limit(data, N);
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (multi_set_voltage_limit).");
+            return -1;
+        }
+    }
+
+    int sensorimotor_multi_get_motor_data(supreme::MultiMotorhandler* sensorimotor, double* data, unsigned N) {
+        if (sensorimotor != NULL) {
+            sensorimotor->get_motor_data(data, N);
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (multi_get_data).");
+            return -1;
+        }
+    }
+
+    /* buses without motors are only serviced if they re-probe, see multicord */
+    int sensorimotor_multi_set_reprobe_per_cycle(supreme::MultiMotorhandler* sensorimotor, unsigned n) {
+        if (sensorimotor != NULL) {
+            sensorimotor->set_reprobe_per_cycle(n);
+            return 0;
+        } else {
+            wrn_msg("Motor cord already stopped (multi_set_reprobe_per_cycle).");
+            return -1;
+        }
+    }
+
+    unsigned sensorimotor_multi_get_number_of_buses(supreme::MultiMotorhandler* sensorimotor) {
+        if (sensorimotor == NULL) return 0;
+        return sensorimotor->get_number_of_buses();
+    }
+
+    /* returns the bus a motor was found on, or -1 */
+    int sensorimotor_multi_get_bus(supreme::MultiMotorhandler* sensorimotor, unsigned id) {
+        if (sensorimotor == NULL) return -1;
+        return sensorimotor->get_bus(id);
+    }
+
+    int sensorimotor_multi_ping(supreme::MultiMotorhandler* sensorimotor) {
+        if (sensorimotor == NULL) return -1;
+        return sensorimotor->ping();
+    }
 }
 
@@ -0,0 +1,210 @@
+/*---------------------------------+
+ | Supreme Machines                |
+ | Sensorimotor C++ Library        |
+ | Matthias Kubisch                |
+ | kubisch@informatik.hu-berlin.de |
+ | November 2018                   |
+ +---------------------------------*/
+
+#ifndef SUPREME_MULTICORD_HPP
+#define SUPREME_MULTICORD_HPP
+
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "motorcord.hpp"
+
+namespace supreme {
+
+/* Drives motors distributed over several serial buses.
+
+   Each bus (i.e. USB-to-serial adapter) gets its own motorcord covering the
+   full id range, the motors are discovered by pinging on every bus, all buses
+   concurrently. The bus transactions of one cycle run concurrently, on the
+   calling thread and on persistent worker threads, one per further bus, and
+   execute_cycle returns when all buses are done. Motors are indexed by id as
+   with a single motorcord.
+
+   A bus without motors is left out of the cycles, it would pause for a second
+   and rescan in each of them, stalling all other buses. To find motors
+   connected to it later, rescan or let the buses re-probe a few ids per cycle,
+   see set_reprobe_per_cycle.
+*/
+class multicord {
+
+    std::vector<std::unique_ptr<motorcord>> cords;
+    std::vector<std::size_t> bus_of;   /* motor id -> bus index */
+    std::vector<uint8_t>     serviced; /* buses taking part in the current cycle */
+
+    std::vector<std::thread> workers;
+    std::mutex               mtx;
+    std::condition_variable  cv_start;
+    std::condition_variable  cv_done;
+    uint64_t                 cycle = 0;
+    std::size_t              pending = 0;
+    std::size_t              failed = 0; /* buses with send errors in the current cycle */
+    bool                     stopping = false;
+
+public:
+    /* opens one serial device per bus, e.g. by name or path, see serial_options */
+    multicord(uint8_t number_of_boards, std::vector<serial_options> const& buses, bool verbose = false)
+    : cords(), bus_of(number_of_boards, 0), serviced(), workers(), mtx(), cv_start(), cv_done()
+    {
+        assert(not buses.empty());
+        for (auto const& options : buses)
+            cords.emplace_back(new motorcord(number_of_boards, verbose, options));
+        start_workers();
+    }
+
+    /* uses the given transports, e.g. simulated buses, which must outlive the multicord */
+    multicord(uint8_t number_of_boards, std::vector<communication_interface*> const& transports, bool verbose = false)
+    : cords(), bus_of(number_of_boards, 0), serviced(), workers(), mtx(), cv_start(), cv_done()
+    {
+        assert(not transports.empty());
+        for (communication_interface* t : transports)
+            cords.emplace_back(new motorcord(number_of_boards, verbose, *t));
+        start_workers();
+    }
+
+    ~multicord() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        cv_start.notify_all();
+        for (auto& w : workers) w.join();
+    }
+
+          sensorimotor& operator[] (std::size_t id)       { return (*cords[bus_of.at(id)])[id]; }
+    const sensorimotor& operator[] (std::size_t id) const { return (*cords[bus_of.at(id)])[id]; }
+
+    std::size_t size() const { return bus_of.size(); }
+    std::size_t number_of_buses() const { return cords.size(); }
+    std::size_t get_bus(std::size_t id) const { return bus_of.at(id); }
+
+    motorcord& bus(std::size_t b) { return *cords.at(b); }
+
+    void disable_all(void) { for (auto& c : cords) c->disable_all(); }
+    void reset_statistics(void) { for (auto& c : cords) c->reset_statistics(); }
+
+    /* all buses are scanned again before the next cycle */
+    void rescan(void) { for (auto& c : cords) c->rescan(); }
+
+    void set_reprobe_per_cycle(std::size_t n) { for (auto& c : cords) c->set_reprobe_per_cycle(n); }
+
+    /* runs one cycle on all buses with motors concurrently,
+       returns false if writing to any bus failed */
+    bool execute_cycle()
+    {
+        for (auto const& c : cords)
+            if (c->is_scan_pending()) { scan_for_motors(); break; }
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            for (std::size_t b = 0; b < cords.size(); ++b)
+                serviced[b] = has_motors(b);
+            ++cycle;
+            pending = workers.size();
+            failed = 0;
+        }
+        cv_start.notify_all();
+
+        const bool ok = not serviced[0] or cords[0]->execute_cycle();
+
+        std::unique_lock<std::mutex> lock(mtx);
+        cv_done.wait(lock, [this]{ return pending == 0; });
+        const bool all_ok = ok and failed == 0;
+        lock.unlock();
+
+        update_mapping();
+        return all_ok;
+    }
+
+    /* pings all ids on all buses concurrently, returns the number of motors found */
+    unsigned scan_for_motors()
+    {
+        std::vector<std::thread> scans;
+        for (std::size_t b = 1; b < cords.size(); ++b)
+            scans.emplace_back([this, b]{ cords[b]->scan_for_motors(); });
+        cords[0]->scan_for_motors();
+        for (auto& s : scans) s.join();
+
+        unsigned num_active = 0;
+        for (std::size_t id = 0; id < size(); ++id) {
+            std::size_t found = 0;
+            for (std::size_t b = 0; b < cords.size(); ++b)
+                if ((*cords[b])[id].is_active()) {
+                    if (found++ == 0) bus_of[id] = b;
+                    else wrn_msg("Motor id %zu found on bus %zu and %zu, using bus %zu.", id, bus_of[id], b, bus_of[id]);
+                }
+            num_active += (found > 0);
+        }
+        return num_active;
+    }
+
+    /* true if the motor answered on any bus */
+    bool is_found(std::size_t id) const { return (*this)[id].is_active(); }
+
+    /* waits on bus 0, discarding late responses as motorcord::idle, then drains
+       the other buses without waiting, so their late responses are not left
+       in the queues for the next transactions */
+    void idle(uint64_t duration_us) {
+        idle_until(communication_interface::clock_t::now() + std::chrono::microseconds(duration_us));
+    }
+
+    void idle_until(communication_interface::clock_t::time_point deadline) {
+        cords[0]->idle_until(deadline);
+        for (std::size_t b = 1; b < cords.size(); ++b) cords[b]->drain();
+    }
+
+private:
+
+    void start_workers(void) {
+        serviced.assign(cords.size(), 0);
+        for (std::size_t b = 1; b < cords.size(); ++b)
+            workers.emplace_back(&multicord::run_worker, this, b);
+    }
+
+    /* a bus without motors would pause, unless it re-probes */
+    bool has_motors(std::size_t b) const {
+        return cords[b]->get_number_of_active_motors() > 0 or cords[b]->get_reprobe_per_cycle() > 0;
+    }
+
+    /* motors found again after a rescan of a bus */
+    void update_mapping(void) {
+        for (std::size_t id = 0; id < size(); ++id)
+            if (not (*cords[bus_of[id]])[id].is_active())
+                for (std::size_t b = 0; b < cords.size(); ++b)
+                    if ((*cords[b])[id].is_active()) { bus_of[id] = b; break; }
+    }
+
+    void run_worker(std::size_t b)
+    {
+        lock_thread_stack();
+        uint64_t last_cycle = 0;
+        while (true) {
+            bool due;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv_start.wait(lock, [&]{ return stopping or cycle != last_cycle; });
+                if (stopping) return;
+                last_cycle = cycle;
+                due = serviced[b];
+            }
+
+            const bool ok = not due or cords[b]->execute_cycle();
+
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (not ok) ++failed;
+                if (--pending == 0) cv_done.notify_one();
+            }
+        }
+    }
+};
+
+} /* namespace supreme */
+
+#endif /* SUPREME_MULTICORD_HPP */
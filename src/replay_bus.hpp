@@ -0,0 +1,149 @@
+/*---------------------------------+
+ | Supreme Machines                |
+ | Sensorimotor C++ Library        |
+ | Matthias Kubisch                |
+ | kubisch@informatik.hu-berlin.de |
+ | November 2018                   |
+ +---------------------------------*/
+
+#ifndef SUPREME_REPLAY_BUS_HPP
+#define SUPREME_REPLAY_BUS_HPP
+
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "buffered_communication.hpp"
+#include "bus_capture.hpp"
+
+namespace supreme {
+
+/* Hardware-free transport replaying the received bytes of a bus capture.
+
+   The capture is replayed write by write: each send_msg advances to the next
+   write of the capture and the reads captured after it become available one
+   by one, as they were returned by the serial device, including any framing
+   errors and fragmentation. Nothing is waited for while bytes are left,
+   wait_us and sleep_s return immediately, so the replay runs as fast as the
+   code parsing it. Only once the reads up to the next captured write are
+   delivered, wait_for_data sleeps until the deadline, i.e. a response missing
+   in the capture times out in real time. Received bytes not read when the
+   next write is sent are delivered before it, as late bytes would be with a
+   real bus.
+
+   The bytes sent are discarded, not compared, so the replay is meaningful
+   as long as the motorcord is configured as during the capture. Response
+   times and timeouts do not reflect the captured timing.
+*/
+class replay_bus final : public buffered_communication {
+
+    struct chunk {
+        std::size_t offset;
+        std::size_t length;
+        uint8_t     direction;
+    };
+
+    std::vector<uint8_t> bytes;
+    std::vector<chunk>   chunks;
+    std::size_t          next  = 0;
+    std::size_t          first_write = 0;
+    bool                 loop;
+    bool                 finished = false;
+
+    uint64_t turns    = 0;
+    uint64_t rx_bytes = 0;
+
+    bool is_readable(void) const { return next < chunks.size() and chunks[next].direction == bus_capture::received; }
+
+    void deliver(void) {
+        chunk const& c = chunks[next];
+        if (recv_queue.space() < c.length) return; /* try again after parsing */
+        recv_queue.write(bytes.data() + c.offset, c.length);
+        note_arrival(c.length, clock_t::now());
+        rx_bytes += c.length;
+        ++next;
+    }
+
+public:
+
+    /* loads the capture, with loop = true the replay restarts at its first write when done */
+    explicit replay_bus(const char* path, bool loop = false)
+    : bytes(), chunks(), loop(loop)
+    {
+        FILE* f = fopen(path, "rb");
+        if (f == NULL) { wrn_msg("Could not open bus capture %s.", path); finished = true; return; }
+        fseek(f, 0, SEEK_END);
+        bytes.resize(ftell(f));
+        fseek(f, 0, SEEK_SET);
+        const std::size_t n = fread(bytes.data(), 1, bytes.size(), f);
+        fclose(f);
+
+        bus_capture::file_header header;
+        if (n != bytes.size() or n < sizeof(header) or std::memcmp(bytes.data(), "SMCAPTR1", 8) != 0) {
+            wrn_msg("Invalid bus capture %s.", path);
+            finished = true;
+            return;
+        }
+        std::memcpy(&header, bytes.data(), sizeof(header));
+
+        std::size_t pos = header.header_size;
+        const std::size_t end = std::min<std::size_t>(bytes.size(), header.header_size + header.used);
+        while (pos + sizeof(bus_capture::chunk_header) <= end) {
+            bus_capture::chunk_header ch;
+            std::memcpy(&ch, bytes.data() + pos, sizeof(ch));
+            const std::size_t data = pos + sizeof(ch);
+            if (data + ch.length > end) break;
+            chunks.push_back({ data, ch.length, ch.direction });
+            pos = data + bus_capture::padded(ch.length);
+        }
+
+        while (first_write < chunks.size() and chunks[first_write].direction != bus_capture::sent) ++first_write;
+        finished = (first_write == chunks.size());
+        sts_msg("Replaying %zu chunks of bus capture %s.", chunks.size(), path);
+    }
+
+    /* true if all writes of the capture were replayed (and not looping) */
+    bool is_finished(void) const { return finished; }
+
+    uint64_t get_turns(void)    const { return turns; }    /* writes replayed */
+    uint64_t get_rx_bytes(void) const { return rx_bytes; } /* bytes delivered */
+
+    bool wait_us(unsigned) const { return true; }
+    unsigned get_baudrate(void) const { return 0; } /* the responses are replayed as captured */
+    void sleep_s(unsigned) const {}
+
+    bool wait_for_data(clock_t::time_point deadline) const {
+        if (is_readable()) return true;
+        const auto t0 = clock_t::now();
+        if (deadline != clock_t::time_point::max() and deadline > t0)
+            std::this_thread::sleep_until(deadline); /* nothing more to come */
+        timing.wait_ns += elapsed_ns(t0);
+        return false;
+    }
+
+    void read_msg() {
+        const auto t0 = clock_t::now();
+        if (is_readable()) deliver();
+        timing.read_ns += elapsed_ns(t0);
+    }
+
+    bool send_msg() {
+        assert(send_checksum == 0);
+        const auto t0 = clock_t::now();
+        send_queue.clear();
+
+        while (is_readable() and recv_queue.space() >= chunks[next].length) deliver();
+        while (next < chunks.size() and chunks[next].direction != bus_capture::sent) ++next; /* skips what did not fit */
+
+        if (next == chunks.size() and loop and not finished) next = first_write;
+        if (next == chunks.size()) finished = true;
+        else { ++next; ++turns; }
+
+        timing.send_ns += elapsed_ns(t0);
+        return true;
+    }
+};
+
+} /* namespace supreme */
+
+#endif /* SUPREME_REPLAY_BUS_HPP */
@@ -0,0 +1,65 @@
+#ifndef SUPREME_RESPONSE_TIMEOUT_HPP
+#define SUPREME_RESPONSE_TIMEOUT_HPP
+
+#include <algorithm>
+#include <cmath>
+
+namespace supreme {
+
+struct timeout_settings {
+    bool     adaptive     = false;
+    double   sigma_factor = 4.0;   /* timeout = mean + sigma_factor * stddev + margin */
+    unsigned margin_us    = 100;
+    unsigned floor_us     = 300;
+    unsigned ceiling_us   = 2000;  /* max. response time, used when not adaptive */
+};
+
+/* Per-motor timeout for waiting on responses.
+
+   In adaptive mode the timeout follows the observed response times: mean and
+   variance are tracked as exponential moving averages and the timeout is set
+   to a high percentile estimate, clipped to [floor, ceiling]. Since the true
+   latency of timed-out responses is unknown, each timeout widens the current
+   value by 1/8 until the next response arrives. Otherwise the ceiling is used.
+*/
+class response_timeout {
+    static const unsigned min_samples = 16;
+    constexpr static const double rate = 0.02;
+
+    timeout_settings settings;
+    double   mean_us = .0;
+    double   var_us2 = .0;
+    unsigned samples = 0;
+    unsigned current_us;
+
+public:
+    response_timeout() : settings(), current_us(settings.ceiling_us) {}
+
+    void configure(timeout_settings const& s) { settings = s; reset(); }
+    timeout_settings const& get_settings(void) const { return settings; }
+
+    void reset(void) { mean_us = var_us2 = .0; samples = 0; current_us = settings.ceiling_us; }
+
+    unsigned get_us(void) const { return settings.adaptive ? current_us : settings.ceiling_us; }
+
+    void update(unsigned response_time_us, bool timeout)
+    {
+        if (timeout) {
+            current_us = std::min(settings.ceiling_us, current_us + std::max(1u, current_us / 8));
+            return;
+        }
+
+        if (samples == 0) mean_us = response_time_us;
+        const double diff = response_time_us - mean_us;
+        mean_us += rate * diff;
+        var_us2  = (1.0 - rate) * (var_us2 + rate * diff * diff);
+        if (samples < min_samples) { ++samples; return; }
+
+        const double estimate = mean_us + settings.sigma_factor * std::sqrt(var_us2) + settings.margin_us;
+        current_us = static_cast<unsigned>(std::max<double>(settings.floor_us, std::min<double>(settings.ceiling_us, estimate)));
+    }
+};
+
+} /* namespace supreme */
+
+#endif /* SUPREME_RESPONSE_TIMEOUT_HPP */
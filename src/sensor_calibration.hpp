@@ -0,0 +1,81 @@
+/*---------------------------------+
+ | Supreme Machines                |
+ | Sensorimotor C++ Library        |
+ | Matthias Kubisch                |
+ | kubisch@informatik.hu-berlin.de |
+ | November 2018                   |
+ +---------------------------------*/
+
+#ifndef SUPREME_SENSOR_CALIBRATION_HPP
+#define SUPREME_SENSOR_CALIBRATION_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include "interface_data.hpp"
+
+namespace supreme {
+
+/* the sensor words as received, before any conversion */
+struct raw_sensor_data {
+    uint16_t position       = 32768;
+    uint16_t current        = 0;
+    int16_t  velocity       = 0;
+    uint16_t voltage_supply = 0;
+    int16_t  temperature    = 0;
+    int16_t  acceleration[3] = {0, 0, 0};
+    bool     has_acceleration = false; /* an external sensor response was received */
+};
+
+/* Linear mapping (value = raw * gain + offset) of the sensors of one motor,
+   which are not used by the controllers. The defaults are the nominal
+   values of the board, i.e. Imax = 3.3A and Vmax = 13V at 1023 and the
+   accelerometer offsets of the reference board.
+*/
+struct sensor_calibration {
+    static const std::size_t num_values = 12;
+
+    double current_gain       = 0.003225806;
+    double current_offset     = .0;
+    double voltage_gain       = 0.012713472;
+    double voltage_offset     = .0;
+    double temperature_gain   = 0.01;
+    double temperature_offset = .0;
+    double acceleration_gain  [3] = { 1/2048.0, 1/2048.0, 1/2048.0 };
+    double acceleration_offset[3] = { -4/2048.0, 4/2048.0, -35/2048.0 };
+
+    /* values in the order of the members */
+    void get(double* values) const {
+        const double v[num_values] = { current_gain, current_offset, voltage_gain, voltage_offset
+                                     , temperature_gain, temperature_offset
+                                     , acceleration_gain[0], acceleration_gain[1], acceleration_gain[2]
+                                     , acceleration_offset[0], acceleration_offset[1], acceleration_offset[2] };
+        std::copy(v, v + num_values, values);
+    }
+
+    void set(const double* v) {
+        current_gain       = v[0]; current_offset     = v[1];
+        voltage_gain       = v[2]; voltage_offset     = v[3];
+        temperature_gain   = v[4]; temperature_offset = v[5];
+        for (unsigned k = 0; k < 3; ++k) {
+            acceleration_gain  [k] = v[6 + k];
+            acceleration_offset[k] = v[9 + k];
+        }
+    }
+};
+
+/* converts the calibrated sensors, position and velocity are left to the motor */
+inline void decode_sensors(raw_sensor_data const& raw, sensor_calibration const& c, interface_data& data)
+{
+    data.current        = raw.current        * c.current_gain     + c.current_offset;
+    data.voltage_supply = raw.voltage_supply * c.voltage_gain     + c.voltage_offset;
+    data.temperature    = raw.temperature    * c.temperature_gain + c.temperature_offset;
+    if (not raw.has_acceleration) return;
+    data.acceleration.x = raw.acceleration[0] * c.acceleration_gain[0] + c.acceleration_offset[0];
+    data.acceleration.y = raw.acceleration[1] * c.acceleration_gain[1] + c.acceleration_offset[1];
+    data.acceleration.z = raw.acceleration[2] * c.acceleration_gain[2] + c.acceleration_offset[2];
+}
+
+} /* namespace supreme */
+
+#endif /* SUPREME_SENSOR_CALIBRATION_HPP */
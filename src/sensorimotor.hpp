@@ -14,18 +14,20 @@
 
 #include "common/modules.h"
 #include "communication_interface.hpp"
+#include "frame_decoder.hpp"
 #include "interface_data.hpp"
+#include "response_timeout.hpp"
+#include "sensor_calibration.hpp"
 
 #include "controller/pid_control.hpp"
 #include "controller/csl_control.hpp"
 #include "controller/impulse_ctrl.hpp"
+#include "controller/controller_bank.hpp"
 
 /** TODO:
 
-    + make the acceleration sensor mapping configurable
     + count timeouts and display
     + check communication reliability before driving motors
-    + adjust timeout to actual max response time
 
 */
 
@@ -35,27 +37,79 @@ namespace supreme {
 inline double uint16_to_sc(uint16_t word) { return (word - 32768) / 32768.0; }
 inline double  int16_to_sc(uint16_t word) { return (int16_t) word / 32768.0; }
 
-class sensorimotor
+/* Consecutive failed (timed out, corrupted or unsendable) requests after which a
+   motor is quarantined, i.e. no longer commanded but pinged every 'probation_interval'
+   cycles, and consecutive successful ones after which a degraded motor is active again.
+   A quarantine_after of zero disables the quarantine. */
+struct health_settings {
+    unsigned quarantine_after   = 3;
+    unsigned recover_after      = 3;
+    unsigned probation_interval = 100;
+};
+
+/* Change-driven commands: a motor whose voltage frame would repeat the one last
+   sent (and acknowledged) is skipped, i.e. neither commanded nor read, for up to
+   'keepalive_interval' cycles in a row before the frame is sent again. Motors
+   without controller repeat their data request likewise. Skipped motors keep
+   their last sensor values, a keepalive_interval of zero never skips.
+
+   Only idle or holding motors are skipped: open-loop ones (no controller or
+   voltage control) at rest, i.e. with a speed of at most 'rest_velocity'. The
+   position, csl and impulse controllers run on the sensor values of every
+   cycle, skipping them would feed a stale position back into the controller. */
+struct suppression_settings {
+    bool     enabled            = false;
+    unsigned keepalive_interval = 10;
+    double   rest_velocity      = 0.01; /* of the normalized velocity, [0, 1] */
+};
+
+/* A single motor on the bus.
+
+   The transport type is a template parameter: with the default, all bus
+   access goes through the virtual communication_interface, which is what
+   the shared library uses. Given a concrete (final) transport instead, such
+   as communication_controller<>, the calls are resolved at compile time and
+   the whole encode and parse path can be inlined.
+*/
+template <typename Transport = communication_interface>
+class basic_sensorimotor
 {
-    static const unsigned max_response_time_us = 1000;
-    static const unsigned byte_delay_us = 1;
-    static const unsigned ping_timeout_us = 50;
+    typedef communication_interface::clock_t clock_t;
 
-    constexpr static const double voltage_scale = 0.012713472; /* Vmax = 13V -> 1023 */
-    constexpr static const double current_scale = 0.003225806; /* Imax = 3A3 -> 1023 */
+    static const unsigned ping_timeout_us = 1000;
 
     const uint8_t             motor_id;
-    communication_interface&  com;
+    Transport&                com;
     bool                      do_request = true;
     bool                      is_responding = false;
     bool                      voltage_limit_changed = false;
     bool                      read_external_sensor = false;
+    bool                      controller_changed = true;
+    bool                      impulse_changed = false;
+    bool                      awaiting_response = false;
+    unsigned                  responses_expected = 0; /* of the pending request */
+    bool                      sample_response_time = true; /* false for combined or aborted requests */
+    clock_t::time_point       request_time;
+    clock_t::time_point       response_arrival; /* of the frame completing the request */
+    unsigned                  request_timeout_us = 0;
+    unsigned                  request_queue_us   = 0; /* transfer time of the bytes ahead, part of the timeout */
+    response_timeout          timeout;
+    health_settings           health_cfg;
+    unsigned                  consecutive_failures  = 0;
+    unsigned                  consecutive_successes = 0;
+    unsigned                  probation_countdown   = 0;
+    suppression_settings      suppression_cfg;
+    uint16_t                  sent_command   = 0; /* command byte and pwm last sent, 0: unknown */
+    unsigned                  cycles_skipped = 0; /* in a row */
 
     int16_t                   direction = 1;
     double                    scalefactor = 1.0;
     double                    offset = 0.0;
 
     interface_data            data;
+    raw_sensor_data           raw;
+    sensor_calibration        calibration;
+    bool                      deferred_decoding = false;
 
     double                    target_voltage  = .0;
     double                    voltage_limit   = .0;
@@ -67,12 +121,10 @@ class sensorimotor
     impulse_control imp_ctrl;
 
     enum command_state_t {
-        sync0,
-        sync1,
-        processing,
+        pending,
         completed,
         invalid,
-    } syncstate = sync0;
+    } syncstate = pending;
 
 public:
 
@@ -84,29 +136,101 @@ public:
         impulse  = 4,
     } controller = none;
 
-    sensorimotor(uint8_t id, communication_interface& com)
+    /* active: responding, degraded: recently failed, still commanded,
+       quarantined: repeatedly failed, only pinged on probation */
+    enum health_t {
+        active      = 0,
+        degraded    = 1,
+        quarantined = 2,
+    } health = active;
+
+    basic_sensorimotor(uint8_t id, Transport& com)
     : motor_id(id)
     , com(com)
     , data()
+    , raw()
+    , calibration()
     , pos_ctrl(id)
     , csl_ctrl(id)
     , imp_ctrl(id)
     {}
 
-    /* returns the motors data, such as position, current etc. */
+    /* returns the motors data, such as position, current etc.,
+       with deferred decoding only position and velocity are up to date */
     const interface_data& get_data(void) const { return data; }
 
+    /* returns the sensor words of the last responses */
+    const raw_sensor_data& get_raw_data(void) const { return raw; }
+
+    /* converts the sensor words of the last responses, see set_deferred_decoding */
+    void decode_sensors(void) { supreme::decode_sensors(raw, calibration, data); }
+
+    void set_calibration(sensor_calibration const& c) { calibration = c; decode_sensors(); }
+    const sensor_calibration& get_calibration(void) const { return calibration; }
+
+    /* stores the sensor words only, while position and velocity still are decoded
+       on receipt for the controllers, the others are converted by decode_sensors */
+    void set_deferred_decoding(bool enable) { deferred_decoding = enable; }
+
     /* returns the motors_id */
     uint8_t get_id(void) const { return motor_id; }
 
-    /* returns the last known response to ping status */
-    bool is_active(void) const { return is_responding; }
+    /* returns the last known response to ping status, false while quarantined */
+    bool is_active(void) const { return is_responding and health != quarantined; }
+
+    /* true if the motor responded once but is quarantined */
+    bool is_quarantined(void) const { return is_responding and health == quarantined; }
+
+    health_t get_health(void) const { return health; }
+
+    void set_health_settings(health_settings const& s) { health_cfg = s; }
+
+    void set_suppression_settings(suppression_settings const& s) { suppression_cfg = s; sent_command = 0; cycles_skipped = 0; }
+
+    /* change-driven commands: true if the motor is due for a transaction in this cycle,
+       else counts the cycle as skipped, forced e.g. when polling the external sensor */
+    bool is_transaction_due(bool forced = false) {
+        if (not suppression_cfg.enabled or forced or voltage_limit_changed or not is_idle()
+            or command_word() != sent_command or cycles_skipped >= suppression_cfg.keepalive_interval)
+        {
+            cycles_skipped = 0;
+            return true;
+        }
+        ++cycles_skipped;
+        ++data.statistics.skipped;
+        return false;
+    }
+
+    /* open loop and at rest, as last read, see suppression_settings */
+    bool is_idle(void) const {
+        return (controller == Controller_t::none or controller == Controller_t::voltage)
+           and std::abs(data.velocity) <= suppression_cfg.rest_velocity;
+    }
+
+    /* quarantine: counts down the cycles until the next probation ping, true if due */
+    bool is_probation_due(void) {
+        if (probation_countdown > 0) --probation_countdown;
+        return probation_countdown == 0;
+    }
+
+    /* quarantine: pings the motor with its response timeout, the motor becomes
+       degraded if it answers, returns true in this case */
+    bool probe(void) {
+        probation_countdown = health_cfg.probation_interval;
+        enqueue_command_ping();
+        com.read_msg();
+        if (not com.send_msg()) { ++data.statistics.send_errors; return false; }
+        receive_response(timeout.get_us());
+        return health != quarantined;
+    }
 
     /* disables the output stage of the motor by sending data requests only */
-    void disable(void) { controller = Controller_t::none; set_target_voltage(0.); }
+    void disable(void) { set_controller_type(Controller_t::none); set_target_voltage(0.); }
 
+    /* when found, the motor starts as active */
     bool ping(void) {
         is_responding = false;
+        reset_health();
         enqueue_command_ping();
         com.read_msg();
         com.send_msg();
@@ -115,46 +239,135 @@ public:
     }
 
     /* performs a full communication cycle */
-    Statistics_t const& execute_cycle(void)
+    bool execute_cycle(void) { return execute_cycle(read_external_sensor); }
+
+    /* performs a full communication cycle and, if poll_sensor is set, a separate
+       transaction for the external sensor, returns false if a command could not be sent */
+    bool execute_cycle(bool poll_sensor)
     {
-        assert(send_motor_command()); /** TODO: handle connection lost better */
-        receive_response();
-
-        if (read_external_sensor) { /**TODO make sep. method*/
-            enqueue_command_external_sensor_request();
-            com.read_msg();
-            com.send_msg();
-            receive_response(/*ping_timeout_us*/);
+        if (not send_motor_command()) {
+            fail_request();
+            return false;
+        }
+        receive_response(timeout.get_us());
+
+        if (poll_sensor)
+            return poll_external_sensor();
+        return true;
+    }
+
+    /* requests and waits for the external sensor data */
+    bool poll_external_sensor(void) {
+        enqueue_command_external_sensor_request();
+        com.read_msg();
+        if (not com.send_msg()) {
+            fail_request();
+            return false;
+        }
+        receive_response(timeout.get_us());
+        return true;
+    }
+
+    /* pipelined mode: fails the pending request, e.g. if sending it failed */
+    void abort_request(void) {
+        if (awaiting_response and is_pending()) {
+            syncstate = invalid;
+            sample_response_time = false;
+            ++data.statistics.send_errors;
         }
+    }
 
-        return data.statistics;
+    /* pipelined mode: sends the motor command without waiting for the response,
+       with flush=false the command is only enqueued to be sent in bulk by the caller,
+       with poll_sensor the external sensor request follows in the same write and
+       the request completes when both responses are received, queue_us extends
+       the timeout by the transfer time of the bytes on the bus ahead of the request */
+    bool transmit(bool flush = true, bool poll_sensor = false, unsigned queue_us = 0) {
+        begin_request(timeout.get_us() * (poll_sensor ? 2 : 1) + queue_us, poll_sensor ? 2 : 1, queue_us);
+        enqueue_motor_command();
+        if (poll_sensor) enqueue_command_external_sensor_request();
+        if (not flush) return true;
+        com.read_msg(); // read all whats left
+        return com.send_msg();
+    }
+
+    /* pipelined mode: enqueues a ping to be sent in bulk by the caller, see transmit */
+    void transmit_ping(unsigned queue_us = 0) {
+        begin_request(ping_timeout_us + queue_us, 1, queue_us);
+        is_responding = false;
+        reset_health();
+        enqueue_command_ping();
+    }
+
+    /* pipelined mode: the bytes on the bus of the next transmit, the request and the responses */
+    std::size_t request_bytes(bool poll_sensor) const {
+        return (voltage_limit_changed ? 6 : 0) + (controller != Controller_t::none ? 6 : 5) + (poll_sensor ? 6 : 0);
+    }
+    static std::size_t response_bytes(bool poll_sensor) {
+        return 2 + response_length(0x80) + (poll_sensor ? 2 + response_length(0x41) : 0);
+    }
+    static const std::size_t ping_bytes = 5, ping_response_bytes = 2 + response_length(0xE1);
+
+    /* pipelined mode: true until the response was received or timed out */
+    bool is_awaiting_response(void) const { return awaiting_response; }
+
+    /* pipelined mode: point in time when waiting for the response times out */
+    clock_t::time_point response_deadline(void) const { return request_time + std::chrono::microseconds(request_timeout_us); }
+
+    /* pipelined mode: finalizes the statistics when completed or
+       timed out and returns true while still pending */
+    bool update_pending(clock_t::time_point now) {
+        if (not awaiting_response) return false;
+        if (is_pending() and now < response_deadline()) return true;
+        finish_request(elapsed_us(request_time, response_end(now)), request_queue_us);
+        awaiting_response = false;
+        return false;
+    }
+
+    /* decodes a complete response frame (starting with the command byte) of this
+       motor, e.g. demultiplexed by the motorcord, which arrived at the given time,
+       frames arriving after the request was completed are ignored */
+    void dispatch_response(byte_span frame, bool checksum_ok, clock_t::time_point arrival) {
+        if (not is_pending()) return;
+        if (checksum_ok) decode_response(frame);
+        else ++data.statistics.checksum_errors;
+        if (checksum_ok and --responses_expected > 0) return; /* external sensor response follows */
+        syncstate = checksum_ok ? completed : invalid;
+        response_arrival = arrival;
+        if (checksum_ok) is_responding = true; /* failures are left to the health state */
     }
 
     const Statistics_t& get_stats(void) const { return data.statistics; }
-    void reset_statistics(void) { data.statistics = Statistics_t(); }
+    void reset_statistics(void) { data.statistics = Statistics_t(); data.statistics.health = health; timeout.reset(); }
+
+    /* configures the timeout for waiting on responses, see response_timeout */
+    void set_timeout_settings(timeout_settings const& s) { timeout.configure(s); }
+    unsigned get_timeout_us(void) const { return timeout.get_us(); }
 
-    void set_controller_type(Controller_t type) { controller = type; }
+    void set_controller_type(Controller_t type) { controller = type; controller_changed = true; }
 
     Controller_t get_controller_type(void) const { return controller; }
 
-    void set_proportional(double p) { pos_ctrl.Kp = p; }
-    void set_csl_limits(double lo, double hi) { csl_ctrl.limit_hi = hi; csl_ctrl.limit_lo = lo; }
-    void set_target_csl_mode(double m) { csl_ctrl.target_csl_mode = m; }
-    void set_target_csl_fb  (double f) { csl_ctrl.target_csl_fb   = f; }
-    void set_target_position(double p) { pos_ctrl.target_value = p; }
+    void set_proportional(double p) { pos_ctrl.Kp = p; controller_changed = true; }
+    void set_integral    (double i) { pos_ctrl.Ki = i; controller_changed = true; }
+    void set_csl_limits(double lo, double hi) { csl_ctrl.limit_hi = hi; csl_ctrl.limit_lo = lo; controller_changed = true; }
+    void set_target_csl_mode(double m) { csl_ctrl.target_csl_mode = m; controller_changed = true; }
+    void set_target_csl_fb  (double f) { csl_ctrl.target_csl_fb   = f; controller_changed = true; }
+    void set_target_position(double p) { pos_ctrl.target_value = p; controller_changed = true; }
     void set_target_voltage (double v) { target_voltage = clip(v, voltage_limit); }
 
     void set_voltage_limit(double limit) { voltage_limit = clip(limit, 0., 1.); voltage_limit_changed = true; }
 
-    void apply_impulse(double value, unsigned duration) { imp_ctrl.value = value; imp_ctrl.duration = duration; }
+    void apply_impulse(double value, unsigned duration) { imp_ctrl.value = value; imp_ctrl.duration = duration; impulse_changed = true; }
 
     void set_direction(int16_t dir) { direction = dir; }
     void set_scalefactor(double scf) { scalefactor = scf; }
     void set_offset(double o) { offset = o; }
 
-    void set_disable_position_limits(double lo, double hi) { lim_disable_lo = lo; lim_disable_hi = hi; }
+    void set_disable_position_limits(double lo, double hi) { lim_disable_lo = lo; lim_disable_hi = hi; controller_changed = true; }
 
     void set_ext_sensor_readout(bool enable) { read_external_sensor = enable; }
+    bool is_reading_external_sensor(void) const { return read_external_sensor; }
 
     void execute_controller(void)
     {
@@ -167,192 +380,225 @@ public:
         if (controller == Controller_t::impulse ) set_target_voltage( imp_ctrl.step()              ); else imp_ctrl.reset();
     }
 
+    /* controller bank: loads changed controller parameters into entry i of the bank */
+    void load_controller(controller_bank& bank, std::size_t i)
+    {
+        static_assert(static_cast<int>(controller_bank::impulse) == static_cast<int>(Controller_t::impulse), "Controller types must match.");
+        if (controller_changed)
+            bank.load(i, controller, pos_ctrl, csl_ctrl, lim_disable_lo, lim_disable_hi);
+        if (impulse_changed)
+            bank.load_impulse(i, imp_ctrl);
+        controller_changed = impulse_changed = false;
+    }
+
+    /* controller bank: takes over the result of the bank's step for entry i */
+    void apply_controller_output(controller_bank const& bank, std::size_t i)
+    {
+        if (bank.was_disabled(i)) disable();
+        else if (bank.is_driving(i)) set_target_voltage(bank.get_output(i));
+    }
+
 private:
 
     /** TODO: enqueue sync bytes and checksum could be done by someone else since each package is affected */
 
-    void enqueue_command_data_request() {
-        data.output_voltage = .0;
+    void begin_request(unsigned timeout_us, unsigned responses = 1, unsigned queue_us = 0) {
+        syncstate = pending;
+        responses_expected = responses;
+        sample_response_time = (responses == 1); /* combined with the external sensor */
+        request_time = clock_t::now();
+        request_timeout_us = timeout_us;
+        request_queue_us = queue_us;
+        awaiting_response = true;
+    }
+
+    void enqueue_frame(const uint8_t* frame, std::size_t len) {
         com.enqueue_sync_bytes(0xFF);
-        com.enqueue_byte(0xC0);
-        com.enqueue_byte(motor_id);
+        com.enqueue_bytes(frame, len);
         com.enqueue_checksum();
     }
 
+    void enqueue_command_data_request() {
+        data.output_voltage = .0;
+        const uint8_t frame[] = { 0xC0, motor_id };
+        enqueue_frame(frame, sizeof(frame));
+    }
+
     void enqueue_command_ping(void) {
-        com.enqueue_sync_bytes(0xFF);
-        com.enqueue_byte(0xE0);
-        com.enqueue_byte(motor_id);
-        com.enqueue_checksum();
+        const uint8_t frame[] = { 0xE0, motor_id };
+        enqueue_frame(frame, sizeof(frame));
     }
 
     void enqueue_command_set_voltage(double voltage) {
         data.output_voltage = voltage;
-        voltage *= direction; // correct direction
-        com.enqueue_sync_bytes(0xFF);
-        if (voltage >= 0.0) {
-            com.enqueue_byte(0xB0);
-        } else {
-            com.enqueue_byte(0xB1);
-        }
-        com.enqueue_byte(motor_id);
-        uint8_t pwm = static_cast<uint8_t>(round(std::abs(voltage) * 255));
-        com.enqueue_byte(pwm);
-        com.enqueue_checksum();
+        const uint16_t cmd = voltage_command(voltage);
+        const uint8_t frame[] = { static_cast<uint8_t>(cmd >> 8), motor_id, static_cast<uint8_t>(cmd) };
+        enqueue_frame(frame, sizeof(frame));
+    }
+
+    /* command byte (high) and pwm (low) of the voltage frame, direction corrected */
+    uint16_t voltage_command(double voltage) const {
+        voltage *= direction;
+        const uint8_t pwm = static_cast<uint8_t>(round(std::abs(voltage) * 255));
+        return static_cast<uint16_t>((voltage >= 0.0 ? 0xB0 : 0xB1) << 8 | pwm);
+    }
+
+    /* the command enqueue_motor_command would send */
+    uint16_t command_word(void) const {
+        return (controller != Controller_t::none) ? voltage_command(target_voltage) : 0xC000;
     }
 
     void enqueue_command_set_voltage_limit(void) {
         if (not voltage_limit_changed) return;
         if (voltage_limit > 0.5)
             wrn_msg("Changing voltage limit to %1.2f for motor %u", voltage_limit, motor_id);
-        com.enqueue_sync_bytes(0xFF);
-        com.enqueue_byte(0xA0);
-        com.enqueue_byte(motor_id);
-        uint8_t lim_pwm = static_cast<uint8_t>(round(std::abs(voltage_limit) * 255));
-        com.enqueue_byte(lim_pwm);
-        com.enqueue_checksum();
+        const uint8_t lim_pwm = static_cast<uint8_t>(round(std::abs(voltage_limit) * 255));
+        const uint8_t frame[] = { 0xA0, motor_id, lim_pwm };
+        enqueue_frame(frame, sizeof(frame));
         voltage_limit_changed = false;
     }
 
     void enqueue_command_external_sensor_request() {
-        com.enqueue_sync_bytes(0xFF);
-        com.enqueue_byte(0x40);
-        com.enqueue_byte(motor_id);
-        com.enqueue_byte(/*sensor_id=*/1);
-        com.enqueue_checksum();
+        const uint8_t frame[] = { 0x40, motor_id, /*sensor_id=*/1 };
+        enqueue_frame(frame, sizeof(frame));
     }
 
-    std::size_t send_motor_command(void) {
+    void enqueue_motor_command(void) {
         enqueue_command_set_voltage_limit();
         if (controller != Controller_t::none)
             enqueue_command_set_voltage(target_voltage);
         else
             enqueue_command_data_request();
+        sent_command = command_word();
+    }
+
+    std::size_t send_motor_command(void) {
+        enqueue_motor_command();
         com.read_msg(); // read all whats left
         return com.send_msg();
     }
 
-    void receive_response(unsigned timeout_us = max_response_time_us)
+    void receive_response(unsigned timeout_us)
     {
         /* wait for data until timeout */
-        syncstate = sync0;
-        unsigned t_us = 0;
+        syncstate = pending;
+        responses_expected = 1;
+        sample_response_time = true;
+        const auto t_start = clock_t::now();
+        const auto deadline = t_start + std::chrono::microseconds(timeout_us);
         do {
-            while(receive_data());
-        } while(++t_us < timeout_us and is_pending() and com.wait_us(byte_delay_us));
+            receive_data();
+        } while(is_pending() and com.wait_for_data(deadline));
 
-        data.statistics.update(t_us, t_us >= timeout_us, !is_data_valid());
+        finish_request(elapsed_us(t_start, std::max(t_start, response_end(clock_t::now()))));
     }
 
-    /* return code true means continue processing, false: wait for next byte */
-    bool receive_data(void) {
-        com.read_msg();
+    /* the arrival of the response if completed, else now */
+    clock_t::time_point response_end(clock_t::time_point now) const {
+        return is_pending() ? now : std::min(now, std::max(request_time, response_arrival));
+    }
 
-        switch(syncstate)
-        {
-            case sync0:
-                if (com.empty()) return false;
-                if (com.front() == 0xff) { /* receive and eat first sync byte */
-                    syncstate = sync1;
-                    com.reset_checksum();
-                    com.get_byte();
-                }
-                else { /* Unexpected first sync byte */
-                    com.pop(); /* remove byte and try again */
-                }
-                return true;
-
-            case sync1:
-                if (com.empty()) return false;
-                if (com.front() == 0xff) { /* receive and eat second sync byte */
-                    syncstate = processing;
-                    com.get_byte();
-                }
-                else { /* Unexpected second sync byte */
-                    com.pop();         // remove byte..
-                    syncstate = sync0; // and try again
-                }
-                return true;
-
-            case processing: {
-                if (com.empty()) return false;
-                uint8_t cmd = com.front();
-                switch(cmd)
-                {
-                case 0x80: /* state data response */
-                    if (com.size() > 12) { // cmd + id + 2pos + 2cur + 2uba + 2usu +2tmp + chk = 13
-                        com.get_byte(); /* eat command byte */
-                        uint8_t mid = com.get_byte();
-                        if (mid == motor_id) {
-                            data.position        = uint16_to_sc(com.get_word()) * direction * scalefactor + offset;
-                            data.current         = com.get_word() * current_scale;
-                            data.velocity        = int16_to_sc(com.get_word()) * direction * scalefactor;
-                            data.voltage_supply  = com.get_word() * voltage_scale;
-                            data.temperature     = static_cast<int16_t>(com.get_word()) / 100.0;
-                            /**TODO implement voltage_backemf */
-                            com.get_byte(); /* eat checksum */
-                        }
-                        syncstate = (motor_id == mid and com.is_checksum_ok()) ? completed : invalid;
-                        is_responding = (syncstate == completed);
-                        return true;
-                    }
-                    return false;
-
-                case 0xE1: /* ping response */
-                    if (com.size() > 2) {
-                        com.get_byte(); /* eat command byte */
-                        uint8_t mid = com.get_byte();
-                        com.get_byte(); /* eat checksum */
-                        syncstate = (motor_id == mid and com.is_checksum_ok()) ? completed : invalid;
-                        is_responding = (syncstate == completed);
-                        return true;
-                    }
-                    return false;
-
-                case 0x41: /* external sensor response */
-                    if (com.size() > 8) { // cmd + id + x(2), y(2), z(2) + chk = 9
-                        com.get_byte(); /* eat command byte */
-                        uint8_t mid = com.get_byte();
-                        if (mid == motor_id) {
-                            data.acceleration.x = ( static_cast<int16_t>(com.get_word()) -  4 ) / 2048.0; //TODO mapping!
-                            data.acceleration.y = ( static_cast<int16_t>(com.get_word()) +  4 ) / 2048.0;
-                            data.acceleration.z = ( static_cast<int16_t>(com.get_word()) - 35 ) / 2048.0;
-                            com.get_byte(); /* eat checksum */
-                        }
-
-                        syncstate = (motor_id == mid and com.is_checksum_ok()) ? completed : invalid;
-                        is_responding = (syncstate == completed);
-                        return true;
-                    }
-                    return false;
-                default:
-                    /* received unknown command byte */
-                    syncstate = invalid;
-                    return false;
-                } /* switch cmd */
-
-                assert(false);
-                return false;
-                }
-
-            case invalid:
-                /* done, but failed */
-                return false;
-
-            case completed:
-                /* done, message received correctly */
-                return false;
-
-            default:
-                assert(false);
-                return false;
-
-        } /* switch syncstate */
-        assert(false);
-        return false;
+    /* updates statistics and timeout after a response was received or timed out,
+       the timeout is estimated without the time queued behind other requests */
+    void finish_request(unsigned t_us, unsigned queue_us = 0) {
+        data.statistics.update(t_us, is_pending(), !is_data_valid());
+        if (sample_response_time) /* others would bias the estimate */
+            timeout.update(t_us > queue_us ? t_us - queue_us : 0, is_pending());
+        data.statistics.timeout_us = timeout.get_us();
+        update_health(not is_pending() and is_data_valid());
     }
 
+    /* the command could not be sent, counts as failed without waiting */
+    void fail_request(void) {
+        syncstate = invalid;
+        ++data.statistics.send_errors;
+        ++data.statistics.errors;
+        data.statistics.faulted = true;
+        update_health(false);
+    }
 
+    void reset_health(void) {
+        health = active;
+        consecutive_failures = consecutive_successes = 0;
+        data.statistics.health = health;
+        sent_command = 0;
+    }
+
+    /* active -> degraded on the first failure, -> quarantined after 'quarantine_after'
+       consecutive failures, quarantined -> degraded when answering the probation ping,
+       degraded -> active after 'recover_after' consecutive successes */
+    void update_health(bool success)
+    {
+        if (success) {
+            consecutive_failures = 0;
+            ++consecutive_successes;
+            if (health == quarantined) health = degraded;
+            if (health == degraded and consecutive_successes >= health_cfg.recover_after) health = active;
+        } else {
+            consecutive_successes = 0;
+            ++consecutive_failures;
+            sent_command = 0; /* the command may not have arrived, send it again */
+            if (health == active) health = degraded;
+            if (health_cfg.quarantine_after > 0 and consecutive_failures >= health_cfg.quarantine_after) {
+                if (health != quarantined) ++data.statistics.quarantines;
+                health = quarantined;
+                probation_countdown = health_cfg.probation_interval;
+            }
+        }
+        data.statistics.health = health;
+    }
+
+
+    /* reads all bytes received so far and decodes the complete frames at once,
+       a frame of any other motor fails the request as well as unknown commands */
+    void receive_data(void) {
+        com.read_msg();
+        const byte_span received = com.peek(com.size());
+        const std::size_t processed = frame_decoder::scan(received,
+            [&](byte_span frame, bool checksum_ok) {
+                if (frame[1] == motor_id)
+                    dispatch_response(frame, checksum_ok, com.arrival_time(frame.data + frame.size - 1 - received.data));
+                else if (is_pending()) syncstate = invalid;
+            },
+            [this]() {
+                ++data.statistics.unknown_commands;
+                if (is_pending()) syncstate = invalid;
+            });
+        com.consume(processed);
+    }
+
+
+    /* decodes the payload of a complete response frame, starting with the command byte */
+    void decode_response(byte_span frame) {
+        switch(frame[0])
+        {
+        case 0x80: /* state data response */
+            raw.position         = frame.word(2);
+            raw.current          = frame.word(4);
+            raw.velocity         = static_cast<int16_t>(frame.word(6));
+            raw.voltage_supply   = frame.word(8);
+            raw.temperature      = static_cast<int16_t>(frame.word(10));
+            data.position        = uint16_to_sc(raw.position) * direction * scalefactor + offset;
+            data.velocity        = int16_to_sc(raw.velocity) * direction * scalefactor;
+            if (not deferred_decoding) decode_sensors();
+            /**TODO implement voltage_backemf */
+            break;
+
+        case 0xE1: /* ping response */
+            break;
+
+        case 0x41: /* external sensor response */
+            for (unsigned k = 0; k < 3; ++k)
+                raw.acceleration[k] = static_cast<int16_t>(frame.word(2 + 2*k));
+            raw.has_acceleration = true;
+            if (not deferred_decoding) decode_sensors();
+            break;
+
+        default:
+            assert(false);
+            break;
+        }
+    }
 
     bool is_pending(void) const { return syncstate != completed and syncstate != invalid; }
     bool is_data_valid(void) const { return syncstate != invalid; }
@@ -360,8 +606,13 @@ private:
 public:
     command_state_t get_syncstate(void) const { return syncstate; }
 
+    static unsigned elapsed_us(clock_t::time_point t0, clock_t::time_point t1) {
+        return static_cast<unsigned>(std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count());
+    }
+
 };
 
+typedef basic_sensorimotor<> sensorimotor;
 
 } /* namespace supreme */
 
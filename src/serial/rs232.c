@@ -480,6 +480,13 @@ void RS232_flushRXTX(int comport_number)
 }
 
 
+/* returns the file descriptor of an opened port, e.g. for waiting with poll() */
+int RS232_GetFileDescriptor(int comport_number)
+{
+  return Cport[comport_number];
+}
+
+
 #else  /* windows */
 
 #define RS232_PORTNR  16
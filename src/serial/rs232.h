@@ -78,6 +78,10 @@ void RS232_flushTX(int);
 void RS232_flushRXTX(int);
 int RS232_GetPortnr(const char *);
 
+#if defined(__linux__) || defined(__FreeBSD__)
+int RS232_GetFileDescriptor(int);
+#endif
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -0,0 +1,347 @@
+/*---------------------------------+
+ | Supreme Machines                |
+ | Sensorimotor C++ Library        |
+ | Matthias Kubisch                |
+ | kubisch@informatik.hu-berlin.de |
+ | November 2018                   |
+ +---------------------------------*/
+
+#ifndef SUPREME_SHARED_STATE_HPP
+#define SUPREME_SHARED_STATE_HPP
+
+#include <signal.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+
+#include "common/log_messages.h"
+#include "common/shared_memory.h"
+#include "bus_thread.hpp"
+#include "state_export.hpp"
+
+namespace supreme {
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2 and ATOMIC_LLONG_LOCK_FREE == 2,
+              "Shared memory requires lock-free atomics, these are shared between processes.");
+
+/* Serves the state of a bus to other processes, and takes the setpoints of one of them,
+   through two POSIX shared memory objects, see state_server and state_client.
+
+   "<name>" holds the state, readable by all (mode 0644), written once per cycle
+   under a sequence lock: the sequence number is odd while the state is written,
+   a reader copies the state and accepts the copy if the sequence number was
+   even and has not changed meanwhile. Readers never block the bus.
+
+     offset
+        0  uint32   magic "SMSS"
+        4  uint32   version
+        8  uint32   size of the object in bytes
+       12  uint32   number of motors N
+       16  uint32   number of fields F, see state_export::field_t
+       20  int32    pid of the server
+       24  uint32   serving, cleared when the server stopped
+       32  uint64   sequence number
+       40  uint64   cycle
+       48  float64  timestamp, seconds of the steady clock
+       56  float64  table of F rows with N values each, as state_export
+
+   "<name>.cmd" holds the setpoints (a command_snapshot) of the client holding
+   the slot, written the same way and taken over by the bus at the beginning
+   of the next cycle. The mode of this object decides who may write setpoints
+   (default 0600: the user of the server only). Of these, one client process
+   at a time holds the slot, the slot of a terminated process is taken over.
+*/
+struct shared_state_segment {
+    enum { magic_value = 0x53534d53 /* "SMSS" */, current_version = 1 };
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t segment_size;
+    uint32_t num_motors;
+    uint32_t num_fields;
+    int32_t  server_pid;
+    std::atomic<uint32_t> serving;
+    uint32_t reserved;
+    std::atomic<uint64_t> seq;
+    uint64_t cycle;
+    double   timestamp;
+    double   table[state_export::num_fields * motorcord::max_boards];
+};
+
+struct shared_command_segment {
+    enum { magic_value = 0x43534d53 /* "SMSC" */, current_version = 1 };
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t segment_size;
+    std::atomic<int32_t>  writer_pid; /* client holding the slot, 0: free */
+    std::atomic<uint64_t> seq;
+    command_snapshot      commands;
+};
+
+static_assert(offsetof(shared_state_segment, table) == 56, "Unexpected shared state layout.");
+
+/* object names start with a slash */
+inline std::string shared_state_name(std::string const& name) { return (not name.empty() and name[0] == '/') ? name : "/" + name; }
+
+/* true if the process exists, possibly of another user */
+inline bool is_process_alive(int32_t pid) { return pid > 0 and (kill(pid, 0) == 0 or errno == EPERM); }
+
+
+/* the bus side: publishes the state and takes the setpoints of the client holding the slot */
+class state_server final : public bus_endpoint {
+public:
+    state_server() : state_shm(), command_shm(), setpoints() {}
+    ~state_server() { close(); }
+
+    state_server(state_server const&) = delete;
+    state_server& operator=(state_server const&) = delete;
+
+    /* creates both objects, fails if another server serves the name,
+       objects left over by a terminated server are replaced */
+    bool open(std::string const& name, std::size_t num_motors, mode_t command_mode = 0600)
+    {
+        close();
+        const std::string state_name = shared_state_name(name);
+        const std::string command_name = state_name + ".cmd";
+
+        if (not state_shm.create(state_name, sizeof(shared_state_segment), 0644)) {
+            if (errno != EEXIST) return false;
+            if (is_served(state_name)) return false;
+            wrn_msg("Replacing shared state %s left over by a terminated server.", state_name.c_str());
+            shared_memory::unlink(state_name);
+            shared_memory::unlink(command_name);
+            if (not state_shm.create(state_name, sizeof(shared_state_segment), 0644)) return false;
+        }
+        shared_memory::unlink(command_name); /* left over of a crashed server */
+        if (not command_shm.create(command_name, sizeof(shared_command_segment), command_mode)) { close(); return false; }
+
+        state = new (state_shm.data()) shared_state_segment;
+        state->magic        = shared_state_segment::magic_value;
+        state->segment_size = sizeof(shared_state_segment);
+        state->num_motors   = num_motors;
+        state->num_fields   = state_export::num_fields;
+        state->server_pid   = getpid();
+        state->seq.store(0);
+        state->serving.store(1);
+
+        command = new (command_shm.data()) shared_command_segment;
+        command->magic        = shared_command_segment::magic_value;
+        command->segment_size = sizeof(shared_command_segment);
+        command->writer_pid.store(0);
+        command->seq.store(0);
+        new (&command->commands) command_snapshot();
+        last_command_seq = 0;
+
+        /* published last, clients check these before anything else */
+        command->version = shared_command_segment::current_version;
+        std::atomic_thread_fence(std::memory_order_release);
+        state->version = shared_state_segment::current_version;
+
+        sts_msg("Serving the state of %lu motors as %s.", static_cast<unsigned long>(num_motors), state_name.c_str());
+        return true;
+    }
+
+    /* the clients see the server stopped, the names are removed */
+    void close(void) {
+        if (state) state->serving.store(0, std::memory_order_release);
+        state = NULL;
+        command = NULL;
+        state_shm.close();
+        command_shm.close();
+    }
+
+    bool is_open(void) const { return state != NULL; }
+
+    /* bus side, never blocks: a write in progress is taken over in the next cycle */
+    command_snapshot const* take_setpoints(void) override
+    {
+        if (command == NULL) return NULL;
+        const uint64_t s0 = command->seq.load(std::memory_order_acquire);
+        if (s0 == last_command_seq or (s0 & 1)) return NULL;
+        std::memcpy(&setpoints, &command->commands, sizeof(command_snapshot));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (command->seq.load(std::memory_order_relaxed) != s0) return NULL;
+        last_command_seq = s0;
+        return &setpoints;
+    }
+
+    /* bus side */
+    void publish(state_snapshot const& snapshot) override
+    {
+        if (state == NULL) return;
+        const uint64_t s = state->seq.load(std::memory_order_relaxed);
+        state->seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        state->cycle     = snapshot.cycle;
+        state->timestamp = snapshot.timestamp_ns * 1e-9;
+        state_export::write_table(snapshot, state->table, state->num_motors);
+        state->seq.store(s + 2, std::memory_order_release);
+    }
+
+private:
+    /* true if a running server serves the name */
+    static bool is_served(std::string const& state_name) {
+        shared_memory shm;
+        if (not shm.open(state_name, sizeof(shared_state_segment), false)) return false;
+        const shared_state_segment* s = reinterpret_cast<const shared_state_segment*>(shm.data());
+        if (s->serving.load() and is_process_alive(s->server_pid)) {
+            wrn_msg("Shared state %s is served by process %d already.", state_name.c_str(), s->server_pid);
+            return true;
+        }
+        return false;
+    }
+
+    shared_memory           state_shm;
+    shared_memory           command_shm;
+    shared_state_segment*   state   = NULL;
+    shared_command_segment* command = NULL;
+    uint64_t                last_command_seq = 0;
+    command_snapshot        setpoints; /* copy taken by the bus */
+};
+
+
+/* A process reading the state served by a state_server and, if opened as writer
+   holding the slot, writing setpoints. The state can be read zero-copy from
+   segment() between read_begin() and read_validate(), or copied by read(). */
+class state_client {
+public:
+    state_client() : state_shm(), command_shm() {}
+    ~state_client() { close(); }
+
+    state_client(state_client const&) = delete;
+    state_client& operator=(state_client const&) = delete;
+
+    bool open(std::string const& name, bool writer)
+    {
+        close();
+        const std::string state_name = shared_state_name(name);
+        if (not state_shm.open(state_name, sizeof(shared_state_segment), false)) return false;
+        state = reinterpret_cast<const shared_state_segment*>(state_shm.data());
+        if (state->magic != shared_state_segment::magic_value
+            or state->version != shared_state_segment::current_version
+            or state->segment_size != sizeof(shared_state_segment)
+            or state->num_fields != state_export::num_fields)
+        {
+            wrn_msg("Shared state %s has an incompatible layout.", state_name.c_str());
+            close();
+            return false;
+        }
+        if (not is_serving()) { wrn_msg("Shared state %s is not served.", state_name.c_str()); close(); return false; }
+
+        if (writer and not claim(state_name + ".cmd")) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    /* releases the slot */
+    void close(void) {
+        if (command) {
+            int32_t self = getpid();
+            command->writer_pid.compare_exchange_strong(self, 0);
+        }
+        state = NULL;
+        command = NULL;
+        state_shm.close();
+        command_shm.close();
+    }
+
+    bool is_open  (void) const { return state != NULL; }
+    bool is_writer(void) const { return command != NULL; }
+
+    /* false when the server stopped */
+    bool is_serving(void) const { return state and state->serving.load(std::memory_order_acquire) and is_process_alive(state->server_pid); }
+
+    std::size_t size(void) const { return state ? state->num_motors : 0; }
+
+    const shared_state_segment* segment(void) const { return state; }
+
+    /* zero-copy reading: waits for a state being written to complete and returns the sequence number */
+    uint64_t read_begin(void) const {
+        uint64_t s;
+        while ((s = state->seq.load(std::memory_order_acquire)) & 1) std::this_thread::yield();
+        return s;
+    }
+
+    /* true if what was read since read_begin is consistent, else read again */
+    bool read_validate(uint64_t s) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return state->seq.load(std::memory_order_relaxed) == s;
+    }
+
+    /* copies the state of the first N motors, i.e. num_fields rows of N values,
+       returns false if the server stopped or no consistent copy was obtained */
+    bool read(uint64_t& cycle, double& timestamp, double* table, std::size_t N) const
+    {
+        if (not is_serving()) return false;
+        for (unsigned attempt = 0; attempt < max_read_attempts; ++attempt) {
+            const uint64_t s = read_begin();
+            cycle     = state->cycle;
+            timestamp = state->timestamp;
+            state_export::copy_table(state->table, state->num_motors, table, N);
+            if (read_validate(s)) return true;
+        }
+        return false;
+    }
+
+    /* writer: modifies the setpoints by calling f(command_snapshot&), the changes
+       are taken over as a whole at the beginning of the next cycle */
+    template <typename Function>
+    bool write_setpoints(Function f)
+    {
+        if (command == NULL) { wrn_msg("Not opened as writer, ignoring setpoints."); return false; }
+        /* odd already, if a terminated writer left it in the middle of a write */
+        const uint64_t s = command->seq.load(std::memory_order_relaxed) | 1;
+        command->seq.store(s, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        f(command->commands);
+        command->seq.store(s + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    static const unsigned max_read_attempts = 100;
+
+    /* maps the setpoints and takes the slot, if free or held by a terminated process */
+    bool claim(std::string const& command_name)
+    {
+        if (not command_shm.open(command_name, sizeof(shared_command_segment), true)) return false;
+        shared_command_segment* c = reinterpret_cast<shared_command_segment*>(command_shm.data());
+        if (c->magic != shared_command_segment::magic_value
+            or c->version != shared_command_segment::current_version
+            or c->segment_size != sizeof(shared_command_segment))
+        {
+            wrn_msg("Shared setpoints %s have an incompatible layout.", command_name.c_str());
+            return false;
+        }
+
+        const int32_t self = getpid();
+        int32_t holder = 0;
+        while (not c->writer_pid.compare_exchange_strong(holder, self)) {
+            if (holder == self) break;
+            if (is_process_alive(holder)) {
+                wrn_msg("Setpoints of %s are written by process %d.", command_name.c_str(), holder);
+                return false;
+            }
+            /* else retry with the terminated holder */
+        }
+        command = c;
+        return true;
+    }
+
+    shared_memory                 state_shm;
+    shared_memory                 command_shm;
+    const shared_state_segment*   state   = NULL;
+    shared_command_segment*       command = NULL;
+};
+
+} /* namespace supreme */
+
+#endif /* SUPREME_SHARED_STATE_HPP */
@@ -0,0 +1,258 @@
+/*---------------------------------+
+ | Supreme Machines                |
+ | Sensorimotor C++ Library        |
+ | Matthias Kubisch                |
+ | kubisch@informatik.hu-berlin.de |
+ | November 2018                   |
+ +---------------------------------*/
+
+#ifndef SUPREME_SIMULATED_BUS_HPP
+#define SUPREME_SIMULATED_BUS_HPP
+
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+#include "buffered_communication.hpp"
+
+namespace supreme {
+
+struct simulation_settings {
+    unsigned latency_us      = 0;    /* min. delay between the end of a command and its response */
+    unsigned jitter_us       = 0;    /* uniformly distributed extra delay */
+    double   byte_error_rate = 0.0;  /* probability of a bit flip per response byte */
+    unsigned baudrate        = 0;    /* models the transfer time of each byte, 0: no transfer time */
+    unsigned seed            = 1;
+};
+
+/* Hardware-free transport answering the commands of an array of simulated boards.
+
+   Each board with an id below 'number_of_boards' answers data requests (0xC0),
+   voltage commands (0xB0/B1), pings (0xE0) and external sensor requests (0x40)
+   with well-formed responses and applies voltage limits (0xA0). A response
+   becomes readable after the configured latency plus jitter and, if a baudrate
+   is given, after the transfer time of the command and all responses before it,
+   as the boards share a half-duplex bus. The board's motor is a simple first
+   order model driven by the applied voltage, which keeps the controllers busy.
+
+   Waiting is done in real time, with latency and jitter set to zero the
+   responses are available immediately and a cycle consists of framing and
+   parsing only, which is what the benchmark measures.
+*/
+class simulated_bus final : public buffered_communication {
+
+    typedef clock_t::time_point time_point;
+
+    struct board {
+        bool     present       = true;
+        double   position      = .0;
+        double   velocity      = .0;
+        double   voltage       = .0;
+        uint8_t  voltage_limit = 255;
+    };
+
+    struct response {
+        time_point arrival;
+        uint8_t    len;
+        uint8_t    bytes[16];
+    };
+
+    simulation_settings settings;
+    std::vector<board>  boards;
+
+    ring_buffer<response, 256> responses; /* in order of arrival */
+    time_point bus_free;                  /* end of the last response on the wire */
+
+    std::mt19937 rng;
+    std::uniform_real_distribution<double> uniform;
+
+    uint64_t rx_bytes = 0;
+    uint64_t tx_bytes = 0;
+    uint64_t corrupted = 0;
+
+    clock_t::duration byte_time(std::size_t n) const {
+        if (settings.baudrate == 0) return clock_t::duration::zero();
+        return std::chrono::nanoseconds(n * 10 * 1000000000ull / settings.baudrate); /* 8N1 */
+    }
+
+    void idle_until(time_point t) const {
+        /* the last part is spun, sleeping is too coarse for typical response times */
+        const auto spin = std::chrono::microseconds(100);
+        if (t - clock_t::now() > spin) std::this_thread::sleep_until(t - spin);
+        while (clock_t::now() < t);
+    }
+
+    static std::size_t command_length(uint8_t cmd) {
+        switch(cmd) {
+            case 0xC0:
+            case 0xE0: return 3; /* cmd + id + chk */
+            case 0xB0:
+            case 0xB1:
+            case 0xA0:
+            case 0x40: return 4; /* cmd + id + value + chk */
+            default  : return 0;
+        }
+    }
+
+    static void put_word(uint8_t* p, uint16_t w) { p[0] = w >> 8; p[1] = w & 0xff; }
+
+public:
+
+    simulated_bus(std::size_t number_of_boards, simulation_settings const& s = simulation_settings())
+    : settings(s)
+    , boards(number_of_boards)
+    , responses()
+    , bus_free(clock_t::now())
+    , rng(s.seed)
+    , uniform(0.0, 1.0)
+    {}
+
+    void configure(simulation_settings const& s) { settings = s; rng.seed(s.seed); }
+    simulation_settings const& get_settings(void) const { return settings; }
+
+    /* simulates connecting or disconnecting a board */
+    void set_present(std::size_t id, bool present) { boards.at(id).present = present; }
+
+    uint64_t get_rx_bytes(void)  const { return rx_bytes; }  /* response bytes delivered */
+    uint64_t get_tx_bytes(void)  const { return tx_bytes; }  /* command bytes sent */
+    uint64_t get_corrupted(void) const { return corrupted; } /* response bytes with a flipped bit */
+
+    unsigned get_baudrate(void) const { return settings.baudrate; }
+
+    bool wait_us(unsigned usec) const { idle_until(clock_t::now() + std::chrono::microseconds(usec)); return true; }
+    void sleep_s(unsigned  sec) const { std::this_thread::sleep_for(std::chrono::seconds(sec)); }
+
+    bool wait_for_data(time_point deadline) const {
+        const auto t0 = clock_t::now();
+        const bool ready = not responses.empty() and responses.front().arrival <= deadline;
+        idle_until(ready ? responses.front().arrival : deadline);
+        timing.wait_ns += elapsed_ns(t0);
+        return ready;
+    }
+
+    void read_msg() {
+        const auto t0 = clock_t::now();
+        uint8_t delivered[queue_size]; /* captured as one read */
+        std::size_t n = 0;
+        while (not responses.empty()) {
+            response const& r = responses.front();
+            if (r.arrival > t0 or recv_queue.space() < r.len) break;
+            recv_queue.write(r.bytes, r.len);
+            note_arrival(r.len, r.arrival);
+            if (capture) { std::memcpy(delivered + n, r.bytes, r.len); n += r.len; }
+            rx_bytes += r.len;
+            responses.pop();
+        }
+        if (capture) capture->append(bus_capture::received, delivered, n);
+        timing.read_ns += elapsed_ns(t0);
+    }
+
+    /* decodes all commands of the send queue and schedules the responses */
+    bool send_msg() {
+        assert(send_checksum == 0);
+        const auto t0 = clock_t::now();
+        const byte_span buf = { send_queue.peek(), send_queue.size() };
+
+        std::size_t i = 0;
+        while (i + 2 < buf.size) {
+            if (buf[i] != 0xFF or buf[i+1] != 0xFF) { ++i; continue; } /* resync */
+            const std::size_t len = command_length(buf[i+2]);
+            if (len == 0 or i + 2 + len > buf.size) { ++i; continue; }
+
+            uint8_t sum = 0;
+            for (std::size_t k = i; k < i + 2 + len; ++k) sum += buf[k];
+            if (sum == 0)
+                answer(buf.data + i + 2, t0 + byte_time(i + 2 + len));
+            i += 2 + len;
+        }
+
+        tx_bytes += buf.size;
+        if (capture) capture->append(bus_capture::sent, buf.data, buf.size);
+        send_queue.clear();
+        timing.send_ns += elapsed_ns(t0);
+        return true;
+    }
+
+private:
+
+    /* executes a single command and schedules its response, if any */
+    void answer(const uint8_t* cmd, time_point end_of_command)
+    {
+        const uint8_t id = cmd[1];
+        if (id >= boards.size() or not boards[id].present) return;
+        board& b = boards[id];
+
+        response r;
+        uint8_t* p = r.bytes;
+        p[0] = p[1] = 0xFF;
+
+        switch(cmd[0]) {
+            case 0xA0:
+                b.voltage_limit = cmd[2];
+                return; /* no response */
+
+            case 0xE0:
+                p[2] = 0xE1; p[3] = id;
+                r.len = 5;
+                break;
+
+            case 0x40: {
+                p[2] = 0x41; p[3] = id;
+                put_word(p + 4, static_cast<int16_t>(  4 + 2048 * std::sin(b.position)));
+                put_word(p + 6, static_cast<int16_t>( -4 + 2048 * std::cos(b.position)));
+                put_word(p + 8, static_cast<int16_t>( 35));
+                r.len = 11;
+                break;
+            }
+
+            case 0xB0:
+            case 0xB1:
+            case 0xC0: {
+                if (cmd[0] != 0xC0) {
+                    const uint8_t pwm = std::min(cmd[2], b.voltage_limit);
+                    b.voltage = (cmd[0] == 0xB0 ? 1.0 : -1.0) * pwm / 255.0;
+                } else b.voltage = .0;
+
+                /* first order motor model, one step per command */
+                b.velocity += 0.1 * (b.voltage - b.velocity);
+                b.position  = std::max(-1.0, std::min(1.0, b.position + 0.01 * b.velocity));
+
+                p[2] = 0x80; p[3] = id;
+                put_word(p +  4, static_cast<uint16_t>(std::min(65535.0, (b.position + 1.0) * 32768.0)));
+                put_word(p +  6, static_cast<uint16_t>(std::abs(b.voltage) * 300));     /* current */
+                put_word(p +  8, static_cast<int16_t>(b.velocity * 32767));
+                put_word(p + 10, 943);                                                 /* 12V supply */
+                put_word(p + 12, 2500);                                                /* 25.00 degC */
+                r.len = 15;
+                break;
+            }
+
+            default:
+                return;
+        }
+
+        uint8_t sum = 0;
+        for (std::size_t k = 0; k + 1 < r.len; ++k) sum += p[k];
+        p[r.len - 1] = ~sum + 1;
+
+        if (settings.byte_error_rate > .0)
+            for (std::size_t k = 0; k < r.len; ++k)
+                if (uniform(rng) < settings.byte_error_rate) {
+                    p[k] ^= 1 << static_cast<unsigned>(8 * uniform(rng));
+                    ++corrupted;
+                }
+
+        const auto delay = std::chrono::microseconds(settings.latency_us)
+                         + std::chrono::nanoseconds(static_cast<uint64_t>(uniform(rng) * settings.jitter_us * 1000));
+        r.arrival = std::max(bus_free, end_of_command + delay) + byte_time(r.len);
+        bus_free = r.arrival;
+
+        if (not responses.push(r))
+            wrn_msg("Simulated bus overflow, response dropped.");
+    }
+};
+
+} /* namespace supreme */
+
+#endif /* SUPREME_SIMULATED_BUS_HPP */
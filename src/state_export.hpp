@@ -0,0 +1,127 @@
+/*---------------------------------+
+ | Supreme Machines                |
+ | Sensorimotor C++ Library        |
+ | Matthias Kubisch                |
+ | kubisch@informatik.hu-berlin.de |
+ | November 2018                   |
+ +---------------------------------*/
+
+#ifndef SUPREME_STATE_EXPORT_HPP
+#define SUPREME_STATE_EXPORT_HPP
+
+#include <vector>
+#include "bus_thread.hpp"
+
+namespace supreme {
+
+/* Struct-of-arrays view on the full state of all motors, to be mapped
+   once by clients (e.g. as a NumPy array) without copying.
+
+   The table is a contiguous row-major block of doubles with one row per
+   field and one column per motor: table[field * num_motors + motor_index].
+   Its address stays the same for the lifetime of the object, the content
+   changes only when update() is called.
+*/
+class state_export {
+public:
+    enum field_t {
+        position = 0,
+        velocity,
+        current,
+        voltage_supply,
+        voltage_backemf,
+        temperature,
+        acceleration_x,
+        acceleration_y,
+        acceleration_z,
+        output_voltage,
+        active,
+        /* statistics */
+        errors,
+        timeouts,
+        checksum_errors,
+        unknown_commands,
+        response_time_us,
+        avg_resp_time_us,
+        max_resp_time_us,
+        timeout_us,
+        faulted,
+        health,
+        send_errors,
+        skipped,
+        num_fields /* must be last */
+    };
+
+    state_export(std::size_t num_motors)
+    : num_motors(num_motors)
+    , table(num_fields * num_motors, 0.0)
+    {}
+
+    const double* data(void) const { return table.data(); }
+    std::size_t   size(void) const { return num_motors; }
+    uint64_t     cycle(void) const { return last_cycle; }
+    double   timestamp(void) const { return last_timestamp; } /* seconds, steady clock */
+
+    /* copies the table of the first N motors, i.e. num_fields rows of N values */
+    void copy_to(double* dst, std::size_t N) const { copy_table(table.data(), num_motors, dst, N); }
+
+    /* copies the snapshot into the table */
+    void update(state_snapshot const& state)
+    {
+        last_cycle = state.cycle;
+        last_timestamp = state.timestamp_ns * 1e-9;
+        write_table(state, table.data(), num_motors);
+    }
+
+    /* writes the state of the first 'stride' motors into a table of num_fields rows
+       with 'stride' values each, as held by state_export, e.g. in shared memory */
+    static void write_table(state_snapshot const& state, double* table, std::size_t stride)
+    {
+        auto at = [table, stride](field_t f, std::size_t i) -> double& { return table[f * stride + i]; };
+        const std::size_t M = std::min(stride, state.num_motors);
+        for (std::size_t i = 0; i < M; ++i) {
+            auto const& d = state.motor[i];
+            auto const& s = d.statistics;
+            at(position        , i) = d.position;
+            at(velocity        , i) = d.velocity;
+            at(current         , i) = d.current;
+            at(voltage_supply  , i) = d.voltage_supply;
+            at(voltage_backemf , i) = d.voltage_backemf;
+            at(temperature     , i) = d.temperature;
+            at(acceleration_x  , i) = d.acceleration.x;
+            at(acceleration_y  , i) = d.acceleration.y;
+            at(acceleration_z  , i) = d.acceleration.z;
+            at(output_voltage  , i) = d.output_voltage;
+            at(active          , i) = state.active[i];
+            at(errors          , i) = s.errors;
+            at(timeouts        , i) = s.timeouts;
+            at(checksum_errors , i) = s.checksum_errors;
+            at(unknown_commands, i) = s.unknown_commands;
+            at(response_time_us, i) = s.response_time_us;
+            at(avg_resp_time_us, i) = s.avg_resp_time_us;
+            at(max_resp_time_us, i) = s.max_resp_time_us;
+            at(timeout_us      , i) = s.timeout_us;
+            at(faulted         , i) = s.faulted;
+            at(health          , i) = s.health;
+            at(send_errors     , i) = s.send_errors;
+            at(skipped         , i) = s.skipped;
+        }
+    }
+
+    /* copies the first N motors of a table with 'stride' values per row */
+    static void copy_table(const double* table, std::size_t stride, double* dst, std::size_t N) {
+        const std::size_t M = std::min(N, stride);
+        for (std::size_t f = 0; f < num_fields; ++f)
+            std::copy(table + f * stride, table + f * stride + M, dst + f * N);
+    }
+
+private:
+    const std::size_t   num_motors;
+    std::vector<double> table;
+    uint64_t            last_cycle = 0;
+    double              last_timestamp = .0;
+};
+
+} /* namespace supreme */
+
+#endif /* SUPREME_STATE_EXPORT_HPP */
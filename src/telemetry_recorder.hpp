@@ -0,0 +1,207 @@
+/*---------------------------------+
+ | Supreme Machines                |
+ | Sensorimotor C++ Library        |
+ | Matthias Kubisch                |
+ | kubisch@informatik.hu-berlin.de |
+ | November 2018                   |
+ +---------------------------------*/
+
+#ifndef SUPREME_TELEMETRY_RECORDER_HPP
+#define SUPREME_TELEMETRY_RECORDER_HPP
+
+#include <atomic>
+#include <cinttypes>
+#include <cstring>
+#include <vector>
+
+#include "common/log_messages.h"
+#include "common/mapped_file.h"
+#include "interface_data.hpp"
+
+namespace supreme {
+
+/* Records the state of all motors, once per cycle, to a memory-mapped file.
+
+   The file is created with room for a fixed number of records and mapped
+   as a whole, so recording a cycle only copies into the mapping and does not
+   allocate. It may still stall the cycle: the first write to each page of the
+   mapping takes a page fault, and writes may wait on the writeback of dirty
+   pages, see mapped_file. In append mode, records beyond the capacity are
+   dropped (and counted) and the file is truncated to the records written
+   when closed. In ring mode the oldest records are overwritten.
+
+   File format, little-endian, all offsets in bytes:
+
+     header (64 bytes)
+        0  char[8]  magic "SMTELEM1"
+        8  uint32   header size (64)
+       12  uint32   number of motors N
+       16  uint32   record size (16 + 52 N, rounded up to a multiple of 8)
+       20  uint32   flags, bit 0: ring mode
+       24  uint64   capacity in records
+       32  uint64   number of records written (in ring mode possibly > capacity,
+                    record k is found at index k % capacity)
+       40  uint64   number of records dropped (append mode, file full)
+       48  bytes    reserved
+
+     records, starting at offset 64
+        0  uint64   cycle
+        8  uint64   timestamp, ns of the steady (monotonic) clock
+       16  motor[N], 52 bytes each:
+            0  float32[10] position, velocity, current, voltage_supply, voltage_backemf,
+                           temperature, acceleration x, y, z, output_voltage (commanded)
+           40  uint32      response time in us
+           44  uint16[3]   errors, timeouts, checksum_errors in this cycle
+           50  uint8       active
+           51  uint8       faulted
+       followed by 4 bytes of padding for odd N
+
+   See load_recording in py/src/sensorimotor.py for the NumPy dtypes.
+*/
+class telemetry_recorder {
+public:
+
+    struct file_header {
+        char     magic[8];
+        uint32_t header_size;
+        uint32_t num_motors;
+        uint32_t record_size;
+        uint32_t flags;
+        uint64_t capacity;
+        uint64_t count;
+        uint64_t dropped;
+        uint8_t  reserved[16];
+    };
+
+    struct record_header {
+        uint64_t cycle;
+        uint64_t timestamp_ns;
+    };
+
+    struct motor_record {
+        float    position, velocity, current, voltage_supply, voltage_backemf, temperature;
+        float    acceleration_x, acceleration_y, acceleration_z, output_voltage;
+        uint32_t response_time_us;
+        uint16_t errors, timeouts, checksum_errors;
+        uint8_t  active, faulted;
+    };
+
+    static_assert(sizeof(file_header)   == 64, "Unexpected header layout.");
+    static_assert(sizeof(record_header) == 16, "Unexpected record layout.");
+    static_assert(sizeof(motor_record)  == 52, "Unexpected motor record layout.");
+
+    enum flags_t { ring_mode = 1 };
+
+    telemetry_recorder() : file(), last() {}
+    ~telemetry_recorder() { close(); }
+
+    telemetry_recorder(telemetry_recorder const&) = delete;
+    telemetry_recorder& operator=(telemetry_recorder const&) = delete;
+
+    /* creates the file with room for 'capacity' records of 'num_motors' motors */
+    bool open(const char* path, std::size_t num_motors, uint64_t capacity, bool ring)
+    {
+        close();
+        if (capacity == 0) { wrn_msg("Telemetry capacity must be non-zero."); return false; }
+
+        /* padded, so the uint64 fields of every record are aligned */
+        record_size = (sizeof(record_header) + num_motors * sizeof(motor_record) + 7) & ~std::size_t(7);
+        if (not file.create(path, sizeof(file_header) + capacity * record_size)) return false;
+
+        base = file.data();
+        header = reinterpret_cast<file_header*>(base);
+        std::memset(header, 0, sizeof(file_header));
+        std::memcpy(header->magic, "SMTELEM1", 8);
+        header->header_size = sizeof(file_header);
+        header->num_motors  = num_motors;
+        header->record_size = record_size;
+        header->flags       = ring ? ring_mode : 0;
+        header->capacity    = capacity;
+
+        last.assign(num_motors, Statistics_t());
+        sts_msg("Recording telemetry of %zu motors to %s, %" PRIu64 " records.", num_motors, path, capacity);
+        return true;
+    }
+
+    /* flushes the mapping, in append mode the file is truncated to the records written */
+    void close(void)
+    {
+        if (not file.is_open()) return;
+        const uint64_t written = std::min(header->count, header->capacity);
+        sts_msg("Telemetry recording stopped, %" PRIu64 " records, %" PRIu64 " dropped.", header->count, header->dropped);
+        file.close(sizeof(file_header) + written * record_size); /* no-op in ring mode */
+        base = NULL;
+        header = NULL;
+    }
+
+    bool is_open(void) const { return file.is_open(); }
+
+    uint64_t get_count(void)   const { return header ? header->count   : 0; }
+    uint64_t get_dropped(void) const { return header ? header->dropped : 0; }
+
+    /* appends one record of all motors, which are accessed as motors[i], i < motors.size(),
+       providing get_data() and is_active() like a motorcord */
+    template <typename Motors>
+    void record(uint64_t cycle, uint64_t timestamp_ns, Motors const& motors)
+    {
+        if (not file.is_open()) return;
+        const uint64_t n = header->count;
+        if (n >= header->capacity and not (header->flags & ring_mode)) {
+            ++header->dropped;
+            return;
+        }
+
+        uint8_t* rec = base + sizeof(file_header) + (n % header->capacity) * record_size;
+        record_header* rh = reinterpret_cast<record_header*>(rec);
+        rh->cycle = cycle;
+        rh->timestamp_ns = timestamp_ns;
+
+        motor_record* mr = reinterpret_cast<motor_record*>(rec + sizeof(record_header));
+        const std::size_t N = std::min<std::size_t>(header->num_motors, motors.size());
+        for (std::size_t i = 0; i < N; ++i) {
+            interface_data const& d = motors[i].get_data();
+            Statistics_t const& s = d.statistics;
+            motor_record& m = mr[i];
+            m.position         = d.position;
+            m.velocity         = d.velocity;
+            m.current          = d.current;
+            m.voltage_supply   = d.voltage_supply;
+            m.voltage_backemf  = d.voltage_backemf;
+            m.temperature      = d.temperature;
+            m.acceleration_x   = d.acceleration.x;
+            m.acceleration_y   = d.acceleration.y;
+            m.acceleration_z   = d.acceleration.z;
+            m.output_voltage   = d.output_voltage;
+            m.response_time_us = s.response_time_us;
+            m.errors           = delta(s.errors         , last[i].errors);
+            m.timeouts         = delta(s.timeouts       , last[i].timeouts);
+            m.checksum_errors  = delta(s.checksum_errors, last[i].checksum_errors);
+            m.active           = motors[i].is_active();
+            m.faulted          = s.faulted;
+            last[i] = s;
+        }
+        for (std::size_t i = N; i < header->num_motors; ++i)
+            std::memset(&mr[i], 0, sizeof(motor_record));
+
+        /* readers of a live recording see complete records only */
+        std::atomic_thread_fence(std::memory_order_release);
+        header->count = n + 1;
+    }
+
+private:
+
+    /* counts since the last record, statistics may have been reset in between */
+    static uint16_t delta(unsigned now, unsigned before) {
+        return static_cast<uint16_t>(std::min<unsigned>(0xffff, now >= before ? now - before : now));
+    }
+
+    mapped_file  file;
+    uint8_t*     base        = NULL;
+    file_header* header      = NULL;
+    std::size_t  record_size = 0;
+    std::vector<Statistics_t> last; /* statistics at the last record */
+};
+
+} /* namespace supreme */
+
+#endif /* SUPREME_TELEMETRY_RECORDER_HPP */